@@ -66,6 +66,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/socket.h>/* recvmsg() SCM_RIGHTS */
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
@@ -96,41 +97,139 @@ extern int madvise(caddr_t, size_t, int);
 
 /* Note: tagc of 0 ('\0') is reserved to indicate no tag */
 
-bool
-mcdb_findtagstart(struct mcdb * const restrict m,
-                  const char * const restrict key, const size_t klen,
-                  const unsigned char tagc)
+static uint32_t  inline
+mcdb_khash(const struct mcdb_mmap * const restrict map,
+           const char * const restrict key, const size_t klen,
+           const unsigned char tagc)
+  __attribute_nonnull__  __attribute_pure__;
+
+static uint32_t  inline
+mcdb_khash(const struct mcdb_mmap * const restrict map,
+           const char * const restrict key, const size_t klen,
+           const unsigned char tagc)
 {
-    const unsigned char * restrict ptr;
-    uint32_t khash;
-    if (m->map->hash_fn == uint32_hash_djb) {
+    if (map->hash_fn == uint32_hash_djb) {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
             ? uint32_hash_djb_uchar(UINT32_HASH_DJB_INIT, tagc)
             : UINT32_HASH_DJB_INIT;
-        khash = uint32_hash_djb(khash_init, key, klen);
+        return uint32_hash_djb(khash_init, key, klen);
+    }
+    else if (map->hash_fn == uint32_hash_mix) { /*(not streamable)*/
+        return (tagc != 0)
+          ? uint32_hash_mix_tag(map->hash_init, tagc, key, klen)
+          : uint32_hash_mix(map->hash_init, key, klen);
     }
     else {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
-            ? m->map->hash_fn(m->map->hash_init, (const char *)&tagc, 1u)
-            : m->map->hash_init;
-        khash = m->map->hash_fn(khash_init, key, klen);
+            ? map->hash_fn(map->hash_init, (const char *)&tagc, 1u)
+            : map->hash_init;
+        return map->hash_fn(khash_init, key, klen);
     }
+}
 
-    (void) mcdb_thread_refresh_self(m);
-    /* (ignore rc; continue with previous map in case of failure) */
+/* second key hash, independent of khash, seeded w/ khash
+ * (MCDB_FLAG_KEYFP: key fingerprint is computed lazily by mcdb_findtagnext()
+ *  upon first khash and klen match)
+ * (MCDB_FLAG_MPH: selects entry in perfect hash index) */
+static uint32_t  __attribute_noinline__
+mcdb_khash2(const uint32_t khash, const char * const restrict key,
+            const size_t klen, const unsigned char tagc)
+  __attribute_nonnull__  __attribute_pure__;
+
+static uint32_t  __attribute_noinline__
+mcdb_khash2(const uint32_t khash, const char * const restrict key,
+            const size_t klen, const unsigned char tagc)
+{
+    return (tagc != 0)
+      ? uint32_hash_mix_tag(khash, tagc, key, klen)
+      : uint32_hash_mix(khash, key, klen);
+}
+
+/* MCDB_FLAG_MPH: locate single candidate entry in perfect hash index
+ * (m->hpos, m->hslots must be set; m->hslots != 0) */
+static void  __attribute_noinline__
+mcdb_mph_start(struct mcdb * const restrict m, const uint32_t khash,
+               const char * const restrict key, const size_t klen,
+               const unsigned char tagc)
+  __attribute_nonnull__;
+
+static void  __attribute_noinline__
+mcdb_mph_start(struct mcdb * const restrict m, const uint32_t khash,
+               const char * const restrict key, const size_t klen,
+               const unsigned char tagc)
+{
+    const unsigned char * const restrict ptr = m->map->ptr + m->hpos;
+    const uint32_t seed = uint32_strunpack_bigendian_aligned_macro(ptr);
+    const uint32_t nb   = uint32_strunpack_bigendian_aligned_macro(ptr+4);
+    const unsigned char * const restrict dp =
+      ptr + 8 + (mcdb_mph_bucket(khash, seed, nb) << 1);
+    const uint32_t d    = ((uint32_t)dp[0] << 8) | dp[1];
+    const uint32_t pos  = mcdb_mph_pos(mcdb_khash2(khash, key, klen, tagc),
+                                       seed, d, m->hslots);
+    m->kpos = m->hpos + mcdb_mph_hdrsz(nb)
+            + ((uintptr_t)pos << (m->map->b - 1));
+    __builtin_prefetch(m->map->ptr + m->kpos, 0, 2);
+}
+
+/* MCDB_FLAG_MPH: keys are unique; at most one match (one entry, one compare) */
+static bool  __attribute_noinline__
+mcdb_mph_findnext(struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool  __attribute_noinline__
+mcdb_mph_findnext(struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+{
+    const unsigned char * restrict ptr = m->map->ptr + m->kpos;
+    const uintptr_t vpos = (m->map->b == 3)
+      ? uint32_strunpack_bigendian_aligned_macro(ptr)
+      : uint64_strunpack_bigendian_aligned_macro(ptr);
+    if (m->loop != 0 || vpos == 0)
+        return (m->loop = false);
+    m->loop = 1;
+    ptr = m->map->ptr + vpos + 8;
+    m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+    m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+    m->dpos = vpos + 8 + m->klen;
+    if (m->klen == klen+(tagc!=0)
+        && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0)
+        return true;
+    return (m->loop = false);
+}
+
+/* set up lookup in m->map of key with precomputed khash
+ * (caller has refreshed m and hashed key against m->map) */
+static bool  inline
+mcdb_findtagstart_khash(struct mcdb * const restrict m, const uint32_t khash,
+                        const char * const restrict key, const size_t klen,
+                        const unsigned char tagc)
+{
+    const unsigned char * restrict ptr;
 
     /* (size of data in lvl1 hash table element is 16-bytes (shift 4 bits)) */
-    ptr = m->map->ptr + ((khash & MCDB_SLOT_MASK) << 4);
+    ptr = m->map->ptr + m->map->slots
+        + ((khash & ((1u << m->map->slot_bits) - 1)) << 4);
     m->hpos  = uint64_strunpack_bigendian_aligned_macro(ptr);
     m->hslots= uint32_strunpack_bigendian_aligned_macro(ptr+8);
     m->loop  = 0;
+    m->kfp   = ~0u;
     if (__builtin_expect((!m->hslots), 0))
         return false;
+    if (m->map->flags & MCDB_FLAG_MPH) {
+        mcdb_mph_start(m, khash, key, klen, tagc);
+        return true;
+    }
     /* (size of data in lvl2 hash table element is 16-bytes (shift 4 bits)) */
     m->kpos  = m->hpos
-             +(((uintptr_t)((khash>>MCDB_SLOT_BITS) % m->hslots)) << m->map->b);
+             +(((uintptr_t)((khash>>m->map->slot_bits) % m->hslots))
+               << ((m->map->flags & MCDB_FLAG_SWISS)
+                   ? MCDB_SWISS_SHIFT
+                   : m->map->b));
     ptr = m->map->ptr + m->kpos;
     __builtin_prefetch(ptr,0,2);    /*prefetch for mcdb_findtagnext()*/
     __builtin_prefetch(ptr+64,0,2); /*prefetch for mcdb_findtagnext()*/
@@ -138,6 +237,140 @@ mcdb_findtagstart(struct mcdb * const restrict m,
     return true;
 }
 
+bool
+mcdb_findtagstart(struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+{
+    (void) mcdb_thread_refresh_self(m);
+    /* (ignore rc; continue with previous map in case of failure) */
+    /* (hash after refresh; hash id and seed are per mcdb file) */
+    return mcdb_findtagstart_khash(m, mcdb_khash(m->map, key, klen, tagc),
+                                   key, klen, tagc);
+}
+
+/* SIMD probe of lvl2 hash table: test a cache line (64 bytes) of hash table
+ * entries (8 entries if b==3, 4 entries if b==4) against khash in one pass,
+ * returning bitmask with 1 bit per 4 bytes of entries, from which caller
+ * extracts khash candidate entries and empty (dpos == 0) entries.
+ * b==3: 2 bits per entry: bit (e*2) khash match, bit (e*2+1) empty
+ * b==4: 4 bits per entry: bit (e*4) khash and klen match, bit (e*4+2) empty
+ * Cache line is 64-byte aligned so that no cache line is touched which would
+ * not also be touched by scalar probe.  Entries in cache line before kpos or
+ * after end of hash table are masked off by caller.  (Aligned cache line
+ * containing kpos lies within the page containing kpos and is readable.)
+ * (SSE2 is baseline on x86_64; AVX2 used if compiled with -mavx2) */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MCDB_SIMD_PROBE
+static uint32_t  inline
+mcdb_probe_mask(const unsigned char * const restrict ptr, const __m256i cmp)
+{
+    const __m256i x0=_mm256_cmpeq_epi32(_mm256_load_si256((__m256i *)ptr),cmp);
+    const __m256i x1=_mm256_cmpeq_epi32(_mm256_load_si256((__m256i *)(ptr+32)),
+                                        cmp);
+    return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(x0))
+         | (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(x1)) << 8;
+}
+#define mcdb_probe_cmp(a,b,c,d) _mm256_set_epi32((d),(c),(b),(a),(d),(c),(b),(a))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MCDB_SIMD_PROBE
+static uint32_t  inline
+mcdb_probe_mask(const unsigned char * const restrict ptr, const __m128i cmp)
+{
+    const __m128i x0=_mm_cmpeq_epi32(_mm_load_si128((__m128i *)ptr),   cmp);
+    const __m128i x1=_mm_cmpeq_epi32(_mm_load_si128((__m128i *)(ptr+16)),cmp);
+    const __m128i x2=_mm_cmpeq_epi32(_mm_load_si128((__m128i *)(ptr+32)),cmp);
+    const __m128i x3=_mm_cmpeq_epi32(_mm_load_si128((__m128i *)(ptr+48)),cmp);
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(x0))
+         | (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(x1)) << 4
+         | (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(x2)) << 8
+         | (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(x3)) << 12;
+}
+#define mcdb_probe_cmp(a,b,c,d) _mm_set_epi32((d),(c),(b),(a))
+#endif
+
+/* MCDB_FLAG_SWISS: bitmask of control bytes in group (first 16 bytes of group)
+ * equal to c; caller masks off bits beyond number of entries in group */
+#ifdef MCDB_SIMD_PROBE
+static uint32_t  inline
+mcdb_swiss_match(const unsigned char * const restrict ptr, const unsigned char c)
+{
+    return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)ptr),
+                     _mm_set1_epi8((char)c)));
+}
+#else
+static uint32_t  inline
+mcdb_swiss_match(const unsigned char * const restrict ptr, const unsigned char c)
+{
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 12; ++i)
+        bits |= (uint32_t)(ptr[i] == c) << i;
+    return bits;
+}
+#endif
+
+/* MCDB_FLAG_SWISS: probe groups of control bytes (see mcdb.h)
+ * (m->kfp holds bitmask of tag matches in current group not yet compared;
+ *  ~0 upon entering group.  m->loop is num groups entered.) */
+static bool
+mcdb_swiss_findnext(struct mcdb * const restrict m,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool
+mcdb_swiss_findnext(struct mcdb * const restrict m,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc)
+{
+    const unsigned char * restrict ptr;
+    const unsigned char * const restrict mptr = m->map->ptr;
+    const uint32_t b = m->map->b;
+    const uint32_t emask = (1u << mcdb_swiss_entries(b)) - 1;
+    const unsigned char tag = (unsigned char)mcdb_swiss_tag(
+      uint32_strunpack_bigendian_aligned_macro(&m->khash));
+    const uintptr_t hslots_end =
+      m->hpos + (((uintptr_t)m->hslots) << MCDB_SWISS_SHIFT);
+    uintptr_t vpos;
+
+    for (;;) {
+        ptr = mptr + m->kpos;
+        if (m->kfp == ~0u) {  /* enter group */
+            if (m->loop == m->hslots)
+                break;
+            ++m->loop;
+            m->kfp = mcdb_swiss_match(ptr, tag) & emask;
+        }
+        while (m->kfp != 0) {
+            const uint32_t e = (uint32_t)__builtin_ctz(m->kfp);
+            m->kfp &= m->kfp - 1;
+            vpos = (b == 3)
+              ? uint32_strunpack_bigendian_aligned_macro(
+                  ptr + mcdb_swiss_dpos(b) + (e << 2))
+              : uint64_strunpack_bigendian_aligned_macro(
+                  ptr + mcdb_swiss_dpos(b) + (e << 3));
+            ptr = mptr + vpos + 8;
+            m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+            m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+            m->dpos = vpos + 8 + m->klen;
+            if (m->klen == klen+(tagc!=0)
+                && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0)
+                return true;
+            ptr = mptr + m->kpos;
+        }
+        if (mcdb_swiss_match(ptr, 0) & emask)
+            break;  /* group contains empty entry; key not in table */
+        m->kpos += (1u << MCDB_SWISS_SHIFT);
+        if (__builtin_expect((m->kpos == hslots_end), 0))
+            m->kpos = m->hpos;
+        m->kfp = ~0u;
+    }
+    return (m->loop = false);
+}
+
 bool
 mcdb_findtagnext(struct mcdb * const restrict m,
                  const char * const restrict key, const size_t klen,
@@ -149,8 +382,45 @@ mcdb_findtagnext(struct mcdb * const restrict m,
     uintptr_t vpos;
     uint32_t khash;
 
+    if (__builtin_expect((m->map->flags & MCDB_FLAG_SWISS) != 0, 0))
+        return mcdb_swiss_findnext(m, key, klen, tagc);
+    if (__builtin_expect((m->map->flags & MCDB_FLAG_MPH) != 0, 0))
+        return mcdb_mph_findnext(m, key, klen, tagc);
+
     if (m->map->b == 3) {
+      #ifdef MCDB_SIMD_PROBE
+        const uint32_t khash_be = m->khash;
+      #endif
         while (m->loop < m->hslots) {
+          #ifdef MCDB_SIMD_PROBE
+            /* skip ahead over entries not matching khash in cache line,
+             * stopping at first candidate (handled below) or at first empty
+             * (first entry is probed scalar; most lookups end there) */
+            if (m->loop != 0 && m->hslots - m->loop >= 8) {
+                const uintptr_t gpos = m->kpos & ~(uintptr_t)63;
+                const uint32_t lo = (uint32_t)(m->kpos - gpos) >> 2;
+                const uint32_t hi = (gpos + 64 <= hslots_end)
+                  ? 16u
+                  : (uint32_t)(hslots_end - gpos) >> 2;
+                const uint32_t bits = mcdb_probe_mask(mptr + gpos,
+                    mcdb_probe_cmp((int)khash_be, 0, (int)khash_be, 0))
+                  & (((1u << hi) - 1) & (~0u << lo));
+                if (bits == 0) {
+                    m->loop += (hi - lo) >> 1;
+                    m->kpos  = gpos + (hi << 2);
+                    if (__builtin_expect((m->kpos == hslots_end), 0))
+                        m->kpos = m->hpos;
+                    continue;
+                }
+                else {
+                    const uint32_t e = (uint32_t)__builtin_ctz(bits) >> 1;
+                    if (bits & (2u << (e << 1)))
+                        break;
+                    m->loop += e - (lo >> 1);
+                    m->kpos  = gpos + (e << 3);
+                }
+            }
+          #endif
             ptr = mptr + m->kpos;
             m->kpos += 8;
             if (__builtin_expect((m->kpos == hslots_end), 0))
@@ -174,7 +444,44 @@ mcdb_findtagnext(struct mcdb * const restrict m,
         }
     }
     else {
+        const bool keyfp = (m->map->flags & MCDB_FLAG_KEYFP) != 0;
+      #ifdef MCDB_SIMD_PROBE
+        const uint32_t khash_be = m->khash;
+        uint32_t klen_be;
+        uint32_strpack_bigendian_aligned_macro(&klen_be,
+                                               (uint32_t)(klen+(tagc!=0)));
+      #endif
         while (m->loop < m->hslots) {
+          #ifdef MCDB_SIMD_PROBE
+            /* skip ahead over entries not matching khash and klen in cache
+             * line, stopping at first candidate (below) or at first empty
+             * (first entry is probed scalar; most lookups end there) */
+            if (m->loop != 0 && m->hslots - m->loop >= 4) {
+                const uintptr_t gpos = m->kpos & ~(uintptr_t)63;
+                const uint32_t lo = (uint32_t)(m->kpos - gpos) >> 2;
+                const uint32_t hi = (gpos + 64 <= hslots_end)
+                  ? 16u
+                  : (uint32_t)(hslots_end - gpos) >> 2;
+                uint32_t bits = mcdb_probe_mask(mptr + gpos,
+                    mcdb_probe_cmp((int)khash_be, (int)klen_be, 0, 0));
+                bits = (bits & (bits >> 1)) & 0x5555u /*candidate;empty*/
+                     & (((1u << hi) - 1) & (~0u << lo));
+                if (bits == 0) {
+                    m->loop += (hi - lo) >> 2;
+                    m->kpos  = gpos + (hi << 2);
+                    if (__builtin_expect((m->kpos == hslots_end), 0))
+                        m->kpos = m->hpos;
+                    continue;
+                }
+                else {
+                    const uint32_t e = (uint32_t)__builtin_ctz(bits) >> 2;
+                    if (bits & (4u << (e << 2)))
+                        break;
+                    m->loop += e - (lo >> 2);
+                    m->kpos  = gpos + (e << 4);
+                }
+            }
+          #endif
             ptr = mptr + m->kpos;
             m->kpos += 16;
             if (__builtin_expect((m->kpos == hslots_end), 0))
@@ -182,11 +489,23 @@ mcdb_findtagnext(struct mcdb * const restrict m,
             khash   = *(uint32_t *)ptr; /* m->khash stored bigendian */
             m->klen = uint32_strunpack_bigendian_aligned_macro(ptr+4);
             vpos    = uint64_strunpack_bigendian_aligned_macro(ptr+8);
-            __builtin_prefetch((char *)mptr+vpos+4, 0, 1);
+            if (!keyfp)
+                __builtin_prefetch((char *)mptr+vpos+4, 0, 1);
             if (__builtin_expect((!vpos), 0))
                 break;
             ++m->loop;
             if (khash == m->khash && m->klen == klen+(tagc!=0)) {
+                if (keyfp) { /* reject fingerprint mismatch w/o reading data */
+                    const uint64_t d =
+                      uint64_strunpack_bigendian_aligned_macro(ptr+8);
+                    if (m->kfp == ~0u)
+                        m->kfp = mcdb_keyfp(mcdb_khash2(
+                          uint32_strunpack_bigendian_aligned_macro(&m->khash),
+                          key, klen, tagc));
+                    if ((uint32_t)(d >> 48) != m->kfp)
+                        continue;
+                    vpos = (uintptr_t)(d & MCDB_DPOS48_MASK);
+                }
                 m->dpos = vpos + 8 + m->klen;
                 ptr = mptr + vpos + 8;
                 m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
@@ -198,6 +517,346 @@ mcdb_findtagnext(struct mcdb * const restrict m,
     return (m->loop = false);
 }
 
+/* mcdb_findtagmany() resolves keys in batches of MCDB_FINDMANY_BATCH.
+ * Each lookup is a chain of dependent loads (lvl1 slot header, lvl2 hash table
+ * entry, data record).  Rather than stalling on each load of each key in turn,
+ * each stage is run for all keys in batch, prefetching memory for next stage,
+ * so that cache misses of lookups in batch overlap one another.
+ * (batch size bounds number of outstanding prefetches; roughly number of
+ *  line fill buffers in modern CPUs, with some headroom) */
+#define MCDB_FINDMANY_BATCH 16
+
+size_t
+mcdb_findtagmany(struct mcdb * const restrict m, const size_t n,
+                 const char * const * const restrict keys,
+                 const size_t * const restrict klens,
+                 const unsigned char tagc)
+{
+    uint32_t khash[MCDB_FINDMANY_BATCH];
+    const unsigned char * restrict ptr;
+    const unsigned char * restrict mptr;
+    uintptr_t vpos;
+    size_t found = 0;
+    size_t i, j, bsz;
+
+    for (i = 0; i < n; i += bsz) {
+        bsz = (n - i < MCDB_FINDMANY_BATCH) ? n - i : MCDB_FINDMANY_BATCH;
+
+        /* stage 1: hash keys; prefetch lvl1 slot headers */
+        for (j = 0; j < bsz; ++j) {
+            (void) mcdb_thread_refresh_self(&m[i+j]);
+            /* (ignore rc; continue with previous map in case of failure) */
+            khash[j] = mcdb_khash(m[i+j].map, keys[i+j], klens[i+j], tagc);
+            __builtin_prefetch(m[i+j].map->ptr + m[i+j].map->slots
+                               + ((khash[j]
+                                   & ((1u << m[i+j].map->slot_bits) - 1)) << 4),
+                               0, 1);
+        }
+
+        /* stage 2: read lvl1 slot headers; prefetch lvl2 hash table entries */
+        for (j = 0; j < bsz; ++j) {
+            struct mcdb * const restrict mj = &m[i+j];
+            ptr = mj->map->ptr + mj->map->slots
+                + ((khash[j] & ((1u << mj->map->slot_bits) - 1)) << 4);
+            mj->hpos  = uint64_strunpack_bigendian_aligned_macro(ptr);
+            mj->hslots= uint32_strunpack_bigendian_aligned_macro(ptr+8);
+            mj->loop  = 0;
+            mj->kfp   = ~0u;
+            if (__builtin_expect((!mj->hslots), 0))
+                continue;
+            if (mj->map->flags & MCDB_FLAG_MPH) {
+                mcdb_mph_start(mj, khash[j], keys[i+j], klens[i+j], tagc);
+                continue;
+            }
+            mj->kpos  = mj->hpos
+                      + (((uintptr_t)((khash[j]>>mj->map->slot_bits)
+                                      % mj->hslots))
+                         << ((mj->map->flags & MCDB_FLAG_SWISS)
+                             ? MCDB_SWISS_SHIFT
+                             : mj->map->b));
+            __builtin_prefetch(mj->map->ptr + mj->kpos, 0, 1);
+            uint32_strpack_bigendian_aligned_macro(&mj->khash, khash[j]);
+        }
+
+        /* stage 3: read first lvl2 hash table entry; prefetch data record
+         * (prefetch only if khash matches; most lookups end at first entry) */
+        for (j = 0; j < bsz; ++j) {
+            const struct mcdb * const restrict mj = &m[i+j];
+            if (__builtin_expect((!mj->hslots), 0))
+                continue;
+            mptr = mj->map->ptr;
+            ptr  = mptr + mj->kpos;
+            if (mj->map->flags & MCDB_FLAG_MPH) {
+                vpos = (mj->map->b == 3)
+                  ? uint32_strunpack_bigendian_aligned_macro(ptr)
+                  : uint64_strunpack_bigendian_aligned_macro(ptr);
+                __builtin_prefetch(mptr + vpos, 0, 1);
+                continue;
+            }
+            if (mj->map->flags & MCDB_FLAG_SWISS) {
+                const uint32_t b = mj->map->b;
+                const uint32_t bits = mcdb_swiss_match(ptr,
+                    (unsigned char)mcdb_swiss_tag(khash[j]))
+                  & ((1u << mcdb_swiss_entries(b)) - 1);
+                if (bits != 0) {
+                    const uint32_t e = (uint32_t)__builtin_ctz(bits);
+                    vpos = (b == 3)
+                      ? uint32_strunpack_bigendian_aligned_macro(
+                          ptr + mcdb_swiss_dpos(b) + (e << 2))
+                      : uint64_strunpack_bigendian_aligned_macro(
+                          ptr + mcdb_swiss_dpos(b) + (e << 3));
+                    __builtin_prefetch(mptr + vpos, 0, 1);
+                }
+                continue;
+            }
+            if (*(uint32_t *)ptr != mj->khash) /* m->khash stored bigendian */
+                continue;
+            vpos = (mj->map->b == 3)
+              ? uint32_strunpack_bigendian_aligned_macro(ptr+4)
+              : uint64_strunpack_bigendian_aligned_macro(ptr+8);
+            if (mj->map->flags & MCDB_FLAG_KEYFP)
+                vpos &= MCDB_DPOS48_MASK;
+            __builtin_prefetch(mptr + vpos, 0, 1);
+        }
+
+        /* stage 4: compare keys (memory is now in cache, or is on its way) */
+        for (j = 0; j < bsz; ++j) {
+            if (__builtin_expect((m[i+j].hslots != 0), 1)
+                && mcdb_findtagnext(&m[i+j], keys[i+j], klens[i+j], tagc))
+                ++found;
+        }
+    }
+
+    return found;
+}
+
+/* Non-blocking lookup: mcdb_findtagtrystart(), mcdb_findtagtrynext()
+ * Before each access to mcdb, the page is checked for residency (mincore()).
+ * If page is not resident, MCDB_TRY_WOULDBLOCK is returned with *pos set to
+ * offset in mcdb of page to fetch (e.g. by mcdb_fault_pool_submit()), and
+ * lookup state in struct mcdb is left unchanged, so that caller retries the
+ * same call once the page has been faulted in.  Residency is not guaranteed
+ * to persist between check and access (page could be evicted in between).
+ * (residency is not checked if mcdb is mlock()ed or copied to memory) */
+#if defined(__linux__) || defined(__sun) || defined(__APPLE__) \
+ || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define MCDB_MINCORE
+#endif
+
+static bool  __attribute_noinline__
+mcdb_mmap_resident(const struct mcdb_mmap * const restrict map, uintptr_t pos,
+                   const uintptr_t len, uintptr_t * const restrict fault)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool  __attribute_noinline__
+mcdb_mmap_resident(const struct mcdb_mmap * const restrict map, uintptr_t pos,
+                   const uintptr_t len, uintptr_t * const restrict fault)
+{
+  #ifdef MCDB_MINCORE
+    const long pgsz = sysconf(_SC_PAGESIZE);
+    const uintptr_t psz = pgsz > 0 ? (uintptr_t)pgsz : 4096;
+    const uintptr_t end = (len < map->size - pos) ? pos + len : map->size;
+    unsigned char vec[64];
+    uintptr_t n, i;
+    if (map->mflags & (MCDB_MMAP_MLOCK | MCDB_MMAP_HUGEPAGE))
+        return true;
+    for (pos &= ~(psz - 1); pos < end; pos += n * psz) {
+        n = (end - pos + psz - 1) / psz;
+        if (n > sizeof(vec))
+            n = sizeof(vec);
+        if (mincore(map->ptr + pos, n * psz, (void *)vec) != 0)
+            return true; /*(residency unknown; proceed)*/
+        for (i = 0; i < n; ++i) {
+            if (!(vec[i] & 1)) {
+                *fault = pos + i * psz;
+                return false;
+            }
+        }
+    }
+  #else
+    (void)map; (void)pos; (void)len; (void)fault;
+  #endif
+    return true;
+}
+
+/* compare key with record at vpos; on match, set m->klen, m->dlen, m->dpos
+ * (record header, key, and value pages must be resident) */
+static int  __attribute_noinline__
+mcdb_trykey(struct mcdb * const restrict m, const uintptr_t vpos,
+            const char * const restrict key, const size_t klen,
+            const unsigned char tagc, uintptr_t * const restrict pos)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int  __attribute_noinline__
+mcdb_trykey(struct mcdb * const restrict m, const uintptr_t vpos,
+            const char * const restrict key, const size_t klen,
+            const unsigned char tagc, uintptr_t * const restrict pos)
+{
+    const unsigned char * restrict ptr = m->map->ptr + vpos + 8;
+    uint32_t rklen, dlen;
+    if (!mcdb_mmap_resident(m->map, vpos, 8, pos))
+        return MCDB_TRY_WOULDBLOCK;
+    rklen = uint32_strunpack_bigendian_macro(ptr-8);
+    dlen  = uint32_strunpack_bigendian_macro(ptr-4);
+    if (rklen != klen+(tagc!=0))
+        return MCDB_TRY_NOTFOUND;
+    if (!mcdb_mmap_resident(m->map, vpos+8, rklen, pos))
+        return MCDB_TRY_WOULDBLOCK;
+    if (!((tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0))
+        return MCDB_TRY_NOTFOUND;
+    if (!mcdb_mmap_resident(m->map, vpos+8+rklen, dlen, pos))
+        return MCDB_TRY_WOULDBLOCK;
+    m->klen = rklen;
+    m->dlen = dlen;
+    m->dpos = vpos + 8 + rklen;
+    return MCDB_TRY_FOUND;
+}
+
+int
+mcdb_findtagtrystart(struct mcdb * const restrict m,
+                     const char * const restrict key, const size_t klen,
+                     const unsigned char tagc, uintptr_t * const restrict pos)
+{
+    const struct mcdb_mmap * restrict map;
+    const unsigned char * restrict ptr;
+    uintptr_t hpos, spos;
+    uint32_t khash;
+
+    (void) mcdb_thread_refresh_self(m);
+    /* (ignore rc; continue with previous map in case of failure) */
+    map   = m->map;
+    khash = mcdb_khash(map, key, klen, tagc);
+    spos  = map->slots + ((khash & ((1u << map->slot_bits) - 1)) << 4);
+    if (!mcdb_mmap_resident(map, spos, 16, pos))
+        return MCDB_TRY_WOULDBLOCK;
+    if (map->flags & MCDB_FLAG_MPH) { /* perfect hash header and bucket */
+        ptr  = map->ptr + spos;
+        hpos = uint64_strunpack_bigendian_aligned_macro(ptr);
+        if (uint32_strunpack_bigendian_aligned_macro(ptr+8) != 0) {
+            uint32_t nb;
+            if (!mcdb_mmap_resident(map, hpos, 8, pos))
+                return MCDB_TRY_WOULDBLOCK;
+            ptr = map->ptr + hpos;
+            nb  = uint32_strunpack_bigendian_aligned_macro(ptr+4);
+            if (!mcdb_mmap_resident(map, hpos + 8 + (mcdb_mph_bucket(khash,
+                       uint32_strunpack_bigendian_aligned_macro(ptr), nb)<<1),
+                                    2, pos))
+                return MCDB_TRY_WOULDBLOCK;
+        }
+    }
+    /* (no refresh or rehash; lookup in same map checked for residency) */
+    return mcdb_findtagstart_khash(m, khash, key, klen, tagc)
+      ? MCDB_TRY_FOUND
+      : MCDB_TRY_NOTFOUND;
+}
+
+int
+mcdb_findtagtrynext(struct mcdb * const restrict m,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc, uintptr_t * const restrict pos)
+{
+    const unsigned char * restrict ptr;
+    const unsigned char * const restrict mptr = m->map->ptr;
+    const uint32_t b = m->map->b;
+    uintptr_t vpos;
+    int rc;
+
+    if (m->map->flags & MCDB_FLAG_MPH) {
+        if (!mcdb_mmap_resident(m->map, m->kpos, 1u << (b-1), pos))
+            return MCDB_TRY_WOULDBLOCK;
+        ptr  = mptr + m->kpos;
+        vpos = (b == 3)
+          ? uint32_strunpack_bigendian_aligned_macro(ptr)
+          : uint64_strunpack_bigendian_aligned_macro(ptr);
+        if (m->loop != 0 || vpos == 0)
+            return (m->loop = false);
+        rc = mcdb_trykey(m, vpos, key, klen, tagc, pos);
+        if (rc == MCDB_TRY_FOUND)
+            m->loop = 1;
+        return rc;
+    }
+    else if (m->map->flags & MCDB_FLAG_SWISS) {
+        /* (see mcdb_swiss_findnext()) */
+        const uint32_t emask = (1u << mcdb_swiss_entries(b)) - 1;
+        const unsigned char tag = (unsigned char)mcdb_swiss_tag(
+          uint32_strunpack_bigendian_aligned_macro(&m->khash));
+        const uintptr_t hslots_end =
+          m->hpos + (((uintptr_t)m->hslots) << MCDB_SWISS_SHIFT);
+        for (;;) {
+            if (!mcdb_mmap_resident(m->map,m->kpos,1u<<MCDB_SWISS_SHIFT,pos))
+                return MCDB_TRY_WOULDBLOCK;
+            ptr = mptr + m->kpos;
+            if (m->kfp == ~0u) {  /* enter group */
+                if (m->loop == m->hslots)
+                    break;
+                ++m->loop;
+                m->kfp = mcdb_swiss_match(ptr, tag) & emask;
+            }
+            while (m->kfp != 0) {
+                const uint32_t e = (uint32_t)__builtin_ctz(m->kfp);
+                vpos = (b == 3)
+                  ? uint32_strunpack_bigendian_aligned_macro(
+                      ptr + mcdb_swiss_dpos(b) + (e << 2))
+                  : uint64_strunpack_bigendian_aligned_macro(
+                      ptr + mcdb_swiss_dpos(b) + (e << 3));
+                rc = mcdb_trykey(m, vpos, key, klen, tagc, pos);
+                if (rc == MCDB_TRY_WOULDBLOCK)
+                    return rc;  /* (entry remains in m->kfp) */
+                m->kfp &= m->kfp - 1;
+                if (rc == MCDB_TRY_FOUND)
+                    return rc;
+            }
+            if (mcdb_swiss_match(ptr, 0) & emask)
+                break;  /* group contains empty entry; key not in table */
+            m->kpos += (1u << MCDB_SWISS_SHIFT);
+            if (__builtin_expect((m->kpos == hslots_end), 0))
+                m->kpos = m->hpos;
+            m->kfp = ~0u;
+        }
+    }
+    else {
+        /* (see mcdb_findtagnext(); entries are probed scalar) */
+        const bool keyfp = (m->map->flags & MCDB_FLAG_KEYFP) != 0;
+        const uintptr_t hslots_end = m->hpos + (((uintptr_t)m->hslots) << b);
+        bool cand;
+        while (m->loop < m->hslots) {
+            if (!mcdb_mmap_resident(m->map, m->kpos, 1u << b, pos))
+                return MCDB_TRY_WOULDBLOCK;
+            ptr = mptr + m->kpos;
+            if (b == 3) {
+                vpos = uint32_strunpack_bigendian_aligned_macro(ptr+4);
+                cand = (*(uint32_t *)ptr == m->khash);
+            }
+            else {
+                vpos = uint64_strunpack_bigendian_aligned_macro(ptr+8);
+                cand = (*(uint32_t *)ptr == m->khash
+                        && uint32_strunpack_bigendian_aligned_macro(ptr+4)
+                           == klen+(tagc!=0));
+                if (cand && keyfp) {
+                    if (m->kfp == ~0u)
+                        m->kfp = mcdb_keyfp(mcdb_khash2(
+                          uint32_strunpack_bigendian_aligned_macro(&m->khash),
+                          key, klen, tagc));
+                    cand = ((uint32_t)(vpos >> 48) == m->kfp);
+                    vpos &= MCDB_DPOS48_MASK;
+                }
+            }
+            if (__builtin_expect((!vpos), 0))
+                break;
+            rc = cand
+              ? mcdb_trykey(m, vpos, key, klen, tagc, pos)
+              : MCDB_TRY_NOTFOUND;
+            if (rc == MCDB_TRY_WOULDBLOCK)
+                return rc;
+            m->kpos += (1u << b);
+            if (__builtin_expect((m->kpos == hslots_end), 0))
+                m->kpos = m->hpos;
+            ++m->loop;
+            if (rc == MCDB_TRY_FOUND)
+                return rc;
+        }
+    }
+    return (m->loop = false);
+}
+
 /* read value from mmap const db into buffer and return pointer to buffer
  * (return NULL if position (offset) or length to read will be out-of-bounds)
  * Note: caller must terminate with '\0' if desired, i.e. buf[len] = '\0';
@@ -230,26 +889,53 @@ bool
 mcdb_validate_slots(struct mcdb * const restrict m)
 {
     const unsigned char * const restrict ptr = m->map->ptr;
+    const unsigned char * const restrict sptr = ptr + m->map->slots;
+    const uint32_t nslots = 1u << m->map->slot_bits;
     uint32_t u = 0;
     const uint32_t bits = m->map->b;
     uint64_t hpos;
     uint64_t hpos_next;
     uint32_t hslots;
     uint32_t numrecs = 0;
+    const bool mph = (m->map->flags & MCDB_FLAG_MPH) != 0;
+    const bool swiss = (m->map->flags & MCDB_FLAG_SWISS) != 0;
     if (MCDB_HEADER_SZ > m->map->size)
         return false;
-    hpos_next  = uint64_strunpack_bigendian_aligned_macro(ptr);
+    hpos_next  = uint64_strunpack_bigendian_aligned_macro(sptr);
     do {
-        hpos = uint64_strunpack_bigendian_aligned_macro(ptr+u);
-        numrecs += (hslots = uint32_strunpack_bigendian_aligned_macro(ptr+u+8));
+        hpos = uint64_strunpack_bigendian_aligned_macro(sptr+u);
+        hslots = uint32_strunpack_bigendian_aligned_macro(sptr+u+8);
+        numrecs += hslots;
         if (/* __builtin_expect( (*(uint32_t *)(ptr+u+12)) == 0, 1) && */
             __builtin_expect( (hpos == hpos_next), 1)) /*(skip padding == 0)*/
             hpos_next += ((uintptr_t)hslots << bits);
         else
             return false;
-    } while ((u += 16) < MCDB_HEADER_SZ);
-    m->map->n = numrecs >> 1;  /* (hslots / 2) */
-    return (hpos_next == m->map->size);
+        if (swiss)  /*(64-byte groups)*/
+            hpos_next = hpos + ((uintptr_t)hslots << MCDB_SWISS_SHIFT);
+        else if (mph && hslots != 0) { /*(perfect hash index; see mcdb.h)*/
+            if (hpos > m->map->size - 8)
+                return false;
+            hpos_next = hpos + mcdb_mph_tblsz(
+              uint32_strunpack_bigendian_aligned_macro(ptr+hpos+4), hslots, bits);
+        }
+    } while ((u += 16) < (nslots << 4));
+    if (mph || swiss) /*(num recs not derived from hslots; v2 header nrecs)*/
+        return (hpos_next == m->map->size);
+    /*(MCDB_FLAG_SLOTS: lvl1 slot table follows lvl2 hash tables)*/
+    if (m->map->slots != 0 && hpos_next != m->map->slots)
+        return false;
+    if (m->map->version >= 2) { /* cross-check v2 header fields */
+        /*(hash tables sized 125% - 400% of num recs (+1 entry per slot);
+         * see MCDB_MAKE_HSLOTS_PCT_MIN, MCDB_MAKE_HSLOTS_PCT_MAX)*/
+        if ((m->map->n != 0 ? numrecs <= m->map->n : numrecs != 0)
+            || (uint64_t)numrecs > ((uint64_t)m->map->n << 2) + nslots
+            || m->map->eod > uint64_strunpack_bigendian_aligned_macro(sptr))
+            return false;
+    }
+    else
+        m->map->n = numrecs >> 1;  /* (hslots / 2) */
+    return (m->map->slots != 0 || hpos_next == m->map->size);
 }
 
 bool
@@ -284,7 +970,9 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
      */
     unsigned char * const ptr = m->map->ptr;
     iter->ptr  = ptr + MCDB_HEADER_SZ;
-    iter->eod  = ptr + uint64_strunpack_bigendian_aligned_macro(ptr) - 7;
+    iter->eod  = m->map->eod != 0  /* (exact end of data from v2 header) */
+      ? ptr + m->map->eod
+      : ptr + uint64_strunpack_bigendian_aligned_macro(ptr) - 7;
     __builtin_prefetch(iter->ptr,0,3); /*(must be non-faulting load if 0 recs)*/
     iter->klen = 0;
     iter->dlen = 0;
@@ -298,6 +986,17 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
 }
 
 
+uint32_t (*mcdb_hash_fn(const uint32_t hash_id))(uint32_t,
+                                                  const void * restrict,size_t)
+{
+    switch (hash_id) {
+      case MCDB_HASH_DJB:    return uint32_hash_djb;
+      case MCDB_HASH_CRC32C: return uint32_hash_crc32c;
+      case MCDB_HASH_MIX:    return uint32_hash_mix;
+      default:               return NULL;
+    }
+}
+
 /* Note: __attribute_noinline__ is used to mark less frequent code paths
  * to prevent inlining of seldoms used paths, hopefully improving instruction
  * cache hits.
@@ -317,6 +1016,156 @@ mcdb_mmap_unmap(struct mcdb_mmap * const restrict map)
     map->size = 0;    /* map->size initialization required for mcdb_read() */
 }
 
+#define mcdb_hdr_field(ptr,f) \
+  uint32_strunpack_bigendian_aligned_macro((ptr)+mcdb_hdr_field_offset(f))
+
+static bool
+mcdb_mmap_header(struct mcdb_mmap * const restrict map)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool
+mcdb_mmap_header(struct mcdb_mmap * const restrict map)
+{
+    /* read mcdb header fields; O(1) (no scan of slot headers) */
+    const unsigned char * const restrict ptr = map->ptr;
+    const bool hdr = (map->size >= MCDB_HEADER_SZ);
+    if (hdr && mcdb_hdr_field(ptr, MCDB_HDR_MAGIC) == MCDB_HDR_MAGIC_V2) {
+        map->version = mcdb_hdr_field(ptr, MCDB_HDR_VERSION);
+        map->flags   = mcdb_hdr_field(ptr, MCDB_HDR_FLAGS);
+        map->b       = mcdb_hdr_field(ptr, MCDB_HDR_B);
+        map->n       = mcdb_hdr_field(ptr, MCDB_HDR_NRECS);
+        map->eod     = (uintptr_t)
+          (((uint64_t)mcdb_hdr_field(ptr, MCDB_HDR_EOD_HI) << 32)
+                    | mcdb_hdr_field(ptr, MCDB_HDR_EOD_LO));
+        map->gen     =
+          (((uint64_t)mcdb_hdr_field(ptr, MCDB_HDR_GEN_HI) << 32)
+                    | mcdb_hdr_field(ptr, MCDB_HDR_GEN_LO));
+        if (map->flags & ~MCDB_FLAGS_KNOWN)
+            return (errno = ENOTSUP, false); /*(created w/ unknown features)*/
+        if ((map->b != 3 && map->b != 4) || map->version < 2
+            || map->eod < MCDB_HEADER_SZ || map->eod > map->size)
+            return (errno = EINVAL, false);  /*(corrupt v2 header)*/
+        if (map->flags & MCDB_FLAG_SLOTS) {  /*(slot table at end of mcdb)*/
+            map->slot_bits = mcdb_hdr_field(ptr, MCDB_HDR_SLOT_BITS);
+            map->slots     = (uintptr_t)  /*(hpos in header slot)*/
+              uint64_strunpack_bigendian_aligned_macro(ptr);
+            if (map->slot_bits <= MCDB_SLOT_BITS
+                || map->slot_bits > MCDB_SLOT_BITS_MAX
+                || (map->flags & (MCDB_FLAG_MPH|MCDB_FLAG_SWISS))
+                || map->slots < map->eod || map->slots > map->size
+                || map->size - map->slots != (16u << map->slot_bits))
+                return (errno = EINVAL, false);  /*(corrupt v2 header)*/
+        }
+        else {
+            map->slot_bits = MCDB_SLOT_BITS;
+            map->slots     = 0;
+        }
+    }
+    else {  /* mcdb created prior to v2 header (or empty file) */
+        map->version = 1;
+        map->flags   = 0;
+        map->b       = map->size < UINT_MAX || *(uint32_t *)ptr == 0 ? 3u : 4u;
+        map->n       = ~0;
+        map->eod     = 0;
+        map->gen     = 0;
+        map->slot_bits = MCDB_SLOT_BITS;
+        map->slots   = 0;
+    }
+
+    /* hash func id and init value from mcdb header fields (0 if not set) */
+    map->hash_id = hdr ? mcdb_hdr_field(ptr, MCDB_HDR_HASH_ID) : MCDB_HASH_DJB;
+    map->hash_fn = mcdb_hash_fn(map->hash_id);
+    if (__builtin_expect( map->hash_fn == NULL, false))
+        return (errno = ENOTSUP, false); /*(created w/ unknown hash func)*/
+    map->hash_init = map->hash_id != MCDB_HASH_DJB
+      ? mcdb_hdr_field(ptr, MCDB_HDR_HASH_INIT)
+      : UINT32_HASH_DJB_INIT;
+    return true;
+}
+
+/* lock entire mcdb in memory, or else lock header and lvl2 hash tables (index)
+ * which follow data records, so that lookup incurs at most one major fault */
+static bool  __attribute_noinline__
+mcdb_mmap_mlock(const struct mcdb_mmap * const restrict map)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool  __attribute_noinline__
+mcdb_mmap_mlock(const struct mcdb_mmap * const restrict map)
+{
+    uintptr_t pos = 0;
+    if (!(map->mflags & MCDB_MMAP_MLOCK) && map->size > MCDB_HEADER_SZ) {
+        const long pgsz = sysconf(_SC_PAGESIZE);
+        if (mlock(map->ptr, MCDB_HEADER_SZ) != 0)
+            return false;
+        /* (v1 mcdb: hash table of first slot follows data records) */
+        pos = map->eod != 0
+          ? map->eod
+          : (uintptr_t)uint64_strunpack_bigendian_aligned_macro(map->ptr);
+        if (pgsz > 0)
+            pos &= ~((uintptr_t)pgsz - 1);
+    }
+    return pos >= map->size || mlock(map->ptr+pos, map->size-pos) == 0;
+}
+
+/* mtime nanoseconds (mcdb replaced multiple times within same second) */
+#if defined(__APPLE__)
+#define mcdb_st_mtime_nsec(st) ((st).st_mtimespec.tv_nsec)
+#elif defined(st_mtime) /*(st_mtime defined as st_mtim.tv_sec (POSIX.1-2008))*/
+#define mcdb_st_mtime_nsec(st) ((st).st_mtim.tv_nsec)
+#else
+#define mcdb_st_mtime_nsec(st) 0L
+#endif
+
+/* copy mcdb into anonymous memory aligned on (transparent) huge page boundary
+ * (mapping is trimmed to page-rounded size so that munmap(ptr, size) frees it)
+ * (hugetlbfs (MAP_HUGETLB) not used: requires reserved pool and munmap() of
+ *  huge page multiples) */
+#define MCDB_HUGEPAGE_SZ (2u*1024u*1024u)
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+static void *  __attribute_noinline__
+mcdb_mmap_copy(const int fd, const size_t size)
+  __attribute_warn_unused_result__;
+static void *  __attribute_noinline__
+mcdb_mmap_copy(const int fd, const size_t size)
+{
+    const long pgsz = sysconf(_SC_PAGESIZE);
+    const size_t psz = pgsz > 0 ? (size_t)pgsz : 4096;
+    const size_t len = (size + psz - 1) & ~(psz - 1);
+    unsigned char *x, *p;
+    size_t off;
+    ssize_t r;
+    int errsave;
+    if (len > SIZE_MAX - MCDB_HUGEPAGE_SZ)
+        return (errno = ENOMEM, MAP_FAILED);
+    x = mmap(0, len + MCDB_HUGEPAGE_SZ, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (x == MAP_FAILED) return MAP_FAILED;
+    p = (unsigned char *)
+      (((uintptr_t)x + MCDB_HUGEPAGE_SZ - 1) & ~(uintptr_t)(MCDB_HUGEPAGE_SZ-1));
+    if (p != x)
+        munmap(x, (size_t)(p - x));
+    munmap(p + len, (size_t)(x + MCDB_HUGEPAGE_SZ - p));
+  #ifdef MADV_HUGEPAGE
+    (void) madvise(p, len, MADV_HUGEPAGE);
+  #endif
+    for (off = 0; off < size; off += (size_t)r) {
+        r = pread(fd, p+off, size-off, (off_t)off);
+        if (r <= 0) {
+            if (r == -1 && errno == EINTR) { r = 0; continue; }
+            errsave = (r == 0) ? EIO : errno; /*(file truncated while copying)*/
+            munmap(p, len);
+            return (errno = errsave, MAP_FAILED);
+        }
+    }
+    if (mprotect(p, len, PROT_READ) != 0) {
+        errsave = errno;
+        munmap(p, len);
+        return (errno = errsave, MAP_FAILED);
+    }
+    return p;
+}
+
 bool  __attribute_noinline__
 mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
 {
@@ -329,8 +1178,24 @@ mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
   #if !defined(_LP64) && !defined(__LP64__)
     if (st.st_size > (off_t)SIZE_MAX) return (errno = EFBIG, false);
   #endif
-    x = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    if (x == MAP_FAILED) return false;
+    if ((map->mflags & MCDB_MMAP_HUGEPAGE) && st.st_size != 0) {
+        x = mcdb_mmap_copy(fd, (size_t)st.st_size);
+        if (x == MAP_FAILED) return false;
+    }
+    else {
+      #ifdef MAP_POPULATE
+        x = mmap(0, (size_t)st.st_size, PROT_READ,
+                 (map->mflags & MCDB_MMAP_POPULATE)
+                   ? MAP_SHARED | MAP_POPULATE
+                   : MAP_SHARED, fd, 0);
+        if (x == MAP_FAILED) return false;
+      #else
+        x = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (x == MAP_FAILED) return false;
+        if (map->mflags & MCDB_MMAP_POPULATE)
+            posix_madvise(x, (size_t)st.st_size, POSIX_MADV_WILLNEED);
+      #endif
+    }
     __builtin_prefetch((char *)x+960, 0, 3); /*(touch mem page w/ mcdb header)*/
   #if 0 /* disable; does not appear to improve performance */
     /*(peformance hit when hitting an uncached mcdb on my 32-bit Pentium-M)*/
@@ -340,13 +1205,20 @@ mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
   #endif
     map->ptr   = (unsigned char *)x;
     map->size  = (uintptr_t)st.st_size;
-    map->b     = st.st_size < UINT_MAX || *(uint32_t *)x == 0 ? 3u : 4u;
-    map->n     = ~0;
     map->mtime = st.st_mtime;
+    map->mtime_nsec = mcdb_st_mtime_nsec(st);
+    map->ino   = st.st_ino;
+    map->dev   = st.st_dev;
     map->next  = NULL;
+    map->prev  = NULL;
     map->refcnt= 0;
-    map->hash_init = UINT32_HASH_DJB_INIT;
-    map->hash_fn   = uint32_hash_djb;
+    if (__builtin_expect( !mcdb_mmap_header(map), false)
+        || ((map->mflags & (MCDB_MMAP_MLOCK | MCDB_MMAP_MLOCK_INDEX))
+            && !mcdb_mmap_mlock(map))) {
+        const int errsave = errno;
+        mcdb_mmap_unmap(map);  /*(munmap() also unlocks)*/
+        return (errno = errsave, false);
+    }
     return true;
 }
 
@@ -378,6 +1250,12 @@ void  __attribute_noinline__
 mcdb_mmap_destroy(struct mcdb_mmap * const restrict map)
 {
     if (map == NULL) return;
+    while (map->prev != NULL) { /* replaced mcdb_mmap not yet reclaimed */
+        struct mcdb_mmap * const prev = map->prev;
+        map->prev = prev->prev;
+        prev->fname = NULL;     /* do not free(prev->fname); shared with map */
+        mcdb_mmap_free(prev);
+    }
     if (map->dfd != -1) {
         (void) nointr_close(map->dfd);
         map->dfd = -1;
@@ -421,7 +1299,9 @@ mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
                       :
                   #endif
                         stat(map->fname, &st) == 0 )
-                && map->mtime != st.st_mtime ) );
+                && (map->mtime != st.st_mtime
+                    || map->mtime_nsec != mcdb_st_mtime_nsec(st)
+                    || map->ino != st.st_ino || map->dev != st.st_dev) ) );
 }
 
 /*
@@ -436,7 +1316,8 @@ mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
  *   maintenance thread: mcdb_mmap_create(...)
  *
  *   maintenance thread: mcdb_mmap_refresh_threadsafe(&map) (periodic/triggered)
- *   querying threads:   mcdb_thread_register(m)
+ *     (or w = mcdb_mmap_watch(&map) once, and mcdb_mmap_unwatch(w) at end)
+ *   querying threads:   m->map = mcdb_mmap_thread_register_shared(&map)
  *   querying threads:   mcdb_find(m,key,klen)          (repeat for may lookups)
  *   querying threads:   mcdb_thread_unregister(m)
  *
@@ -456,13 +1337,17 @@ mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
  * Note: use return value from mcdb_mmap_create().  If an error occurs during
  * mcdb_mmap_create(), fn_free(map) is called, whether or not map or NULL was
  * passed as first argument to mcdb_mmap_create().
+ *
+ * mcdb_mmap_create_flags() takes additional flags (enum mcdb_mmap_flags) to
+ * prefault or lock mcdb in memory, e.g. to avoid major page faults on lookup.
  */
 __attribute_noinline__
 struct mcdb_mmap *
-mcdb_mmap_create(struct mcdb_mmap * restrict map,
-                 const char * const dname  __attribute_unused__,
-                 const char * const fname,
-                 void * (*fn_malloc)(size_t), void (*fn_free)(void *))
+mcdb_mmap_create_flags(struct mcdb_mmap * restrict map,
+                       const char * const dname  __attribute_unused__,
+                       const char * const fname,
+                       void * (*fn_malloc)(size_t), void (*fn_free)(void *),
+                       const int flags)
 {
     char *fbuf;
     size_t flen;
@@ -476,6 +1361,7 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
     map->fn_malloc = fn_malloc;
     map->fn_free   = fn_free;
     map->dfd       = -1;
+    map->mflags    = (uint32_t)flags;
     flen           = strlen(fname);
 
   #if defined(__linux__) || defined(__sun)
@@ -527,69 +1413,443 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
     }
 }
 
-bool  __attribute_noinline__
-mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
-                              const int flags)
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_create(struct mcdb_mmap * const restrict map,
+                 const char * const dname, const char * const fname,
+                 void * (*fn_malloc)(size_t), void (*fn_free)(void *))
 {
-    struct mcdb_mmap *map;
-    struct mcdb_mmap *next = NULL;
-    const bool register_use_incr = ((flags & MCDB_REGISTER_USE_INCR) != 0);
-    #define register_use_decr (!register_use_incr)
+    return mcdb_mmap_create_flags(map, dname, fname, fn_malloc, fn_free, 0);
+}
 
-    if (!(flags & MCDB_REGISTER_MUTEX_UNLOCK_HOLD)
-        && pthread_mutex_lock(&mcdb_global_mutex) != 0)
-        return false;
+/* mcdb passed as fd (e.g. sealed memfd from mcdb_makefn_memfd_finish())
+ * must not be truncated or modified while mapped (SIGBUS), so memfd must be
+ * sealed against shrink and write (fd which can not be sealed is accepted) */
+static bool
+mcdb_mmap_fd_sealed(const int fd)
+{
+  #ifdef F_GET_SEALS
+    const int seals = fcntl(fd, F_GET_SEALS);
+    if (seals != -1
+        && (seals & (F_SEAL_SHRINK|F_SEAL_WRITE))
+             != (F_SEAL_SHRINK|F_SEAL_WRITE))
+        return (errno = EPERM, false);
+  #else
+    (void)fd;
+  #endif
+    return true;
+}
 
-    /*map = *mapptr;*/  /*(ought to be preceded by StoreLoad memory barrier)*/
-    map = *(struct mcdb_mmap * volatile * restrict)mapptr;
-    if (map == NULL || (map->ptr == NULL && register_use_incr)) {
-        if (!(flags & MCDB_REGISTER_MUTEX_LOCK_HOLD))
-            pthread_mutex_unlock(&mcdb_global_mutex);
-        return !register_use_incr; /* succeed if unregister; fail if register */
-        /* If registering, possibly detected race condition in which another
-         * thread released final reference and mcdb was munmap()'d while current
-         * thread waited for lock.  It is now invalid to attempt to register use
-         * of a resource that has been released.  Caller can detect and reopen*/
-    }
+/* mcdb_mmap of mcdb in fd (no filesystem name; mcdb_mmap_refresh_check()
+ * never detects update); caller closes fd (mcdb remains mapped).
+ * Update with mcdb_mmap_reinit_threadsafe() and fd of updated mcdb. */
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_create_fd(struct mcdb_mmap * restrict map, const int fd,
+                    void * (*fn_malloc)(size_t), void (*fn_free)(void *),
+                    const int flags)
+{
+    if (!mcdb_mmap_fd_sealed(fd))
+        return NULL;
+    if (map == NULL && (map = fn_malloc(sizeof(struct mcdb_mmap))) == NULL)
+        return NULL;
+    /* initialize */
+    memset(map, '\0', sizeof(struct mcdb_mmap));
+    map->fn_malloc = fn_malloc;
+    map->fn_free   = fn_free;
+    map->dfd       = -1;
+    map->mflags    = (uint32_t)flags;
+    map->fname     = map->fnamebuf;  /* "" (no name) */
 
-    if (register_use_incr) {
-        if ((next = map->next) == NULL)
-            ++map->refcnt;
-        else {
-            while (next->next != NULL)
-                next = next->next;
-            ++next->refcnt;
-            *mapptr = next;
-        }
+    if (mcdb_mmap_init(map, fd)) {
+        ++map->refcnt;
+        return map;
+    }
+    else {
+        mcdb_mmap_destroy_h(map);
+        return NULL;
     }
+}
 
-    if ((register_use_decr || next != NULL) && --map->refcnt == 0) {
-        /* (above handles refcnt decremented to zero and refcnt already zero) */
-        while ((next = map->next) != NULL && next->refcnt == 0) {
-            map->next = next->next;
-            next->fname = NULL;   /* do not free(next->fname) yet */
-            mcdb_mmap_free(next);
-        }
-        if (!(flags & MCDB_REGISTER_MUNMAP_SKIP)) {
-            map->fname = NULL;    /* do not free(map->fname) yet */
-            mcdb_mmap_free(map);
-            if (register_use_decr)
-                *mapptr = NULL;
+/* receive fd passed over UNIX domain socket (mcdb_makefn_memfd_send())
+ * (-1 w/ errno EBADMSG if message does not contain fd) */
+int
+mcdb_mmap_fd_recv(const int sock)
+{
+    char c;
+    struct iovec iov = { &c, 1 };
+    union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } u;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t r;
+    int fd;
+    memset(&msg, '\0', sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    do {
+      #ifdef MSG_CMSG_CLOEXEC
+        r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+      #else
+        r = recvmsg(sock, &msg, 0);
+      #endif
+    } while (r == -1 && errno == EINTR);
+    if (r == -1)
+        return -1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (r != 1 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+        return (errno = EBADMSG, -1);
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    if (O_CLOEXEC == 0)
+        (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+/*
+ * Thread registration: reader pins of mcdb_mmap
+ *
+ * Each thread registering use of mcdb_mmap records the registration (pin) in
+ * its own struct mcdb_pins (map, count), so that registering and unregistering
+ * use of the current mcdb_mmap writes only to memory of the calling thread
+ * (no mutex, no shared refcnt).  map->refcnt holds references not owned by a
+ * thread: reference from mcdb_mmap_create() (moved to updated mcdb_mmap by
+ * mcdb_mmap_reopen_threadsafe()), and registrations by a thread for which
+ * struct mcdb_pins is full or could not be allocated (atomic ops, taken while
+ * holding mcdb_global_mutex, since map is not protected by pin).
+ *
+ * mcdb_mmap are updated (mcdb_mmap_reopen_threadsafe()) and reclaimed while
+ * holding mcdb_global_mutex, which is not taken on fast path.  A replaced
+ * mcdb_mmap (map->next != NULL) is reclaimed once it has no refcnt and is not
+ * pinned by any thread.  Reclaim proceeds oldest first (map->prev == NULL), so
+ * that a thread holding a pin can safely follow map->next to newest mcdb_mmap.
+ * Thread pinning mcdb_mmap not already pinned by the thread (e.g. from a
+ * shared mcdb_mmap ptr) publishes pin, and then checks that shared ptr still
+ * points to the mcdb_mmap (hazard pointer), since mcdb_mmap_reopen_threadsafe()
+ * updates shared ptr before attempting to reclaim replaced mcdb_mmap.
+ *
+ * (mcdb_mmap unpinned on fast path just as it is replaced might not be
+ *  reclaimed until mcdb_mmap is next replaced, or next thread moves off it)
+ */
+
+#define MCDB_PINS 16  /* num mcdb_mmap pinned per thread w/o atomic refcnt */
+
+struct mcdb_pins {
+  struct mcdb_mmap * volatile map[MCDB_PINS]; /* pinned (read by reclaimer) */
+  uint32_t cnt[MCDB_PINS];                    /* registrations (thread-local) */
+  struct mcdb_pins *next;                     /* list of all mcdb_pins */
+  volatile uint32_t inuse;                    /* owned by a thread */
+};
+
+#ifdef _THREAD_SAFE
+
+#include <stdlib.h>     /* malloc() */
+
+static struct mcdb_pins * volatile mcdb_pins_list;/*(never freed; reused)*/
+static __thread struct mcdb_pins *mcdb_pins_self;
+static pthread_key_t mcdb_pins_key;
+static pthread_once_t mcdb_pins_once = PTHREAD_ONCE_INIT;
+
+/* thread exit: move pins still registered by thread to map->refcnt
+ * (thread exited without unregistering) and release mcdb_pins for reuse */
+static void
+mcdb_pins_release(void * const v)
+{
+    struct mcdb_pins * const restrict pins = (struct mcdb_pins *)v;
+    for (uint32_t i = 0; i < MCDB_PINS; ++i) {
+        if (pins->map[i] != NULL) {
+            __sync_fetch_and_add(&pins->map[i]->refcnt, pins->cnt[i]);
+            pins->map[i] = NULL;
+            pins->cnt[i] = 0;
         }
     }
-    #undef register_use_decr
-
-    if (!(flags & MCDB_REGISTER_MUTEX_LOCK_HOLD))
-        pthread_mutex_unlock(&mcdb_global_mutex);
+    mcdb_pins_self = NULL;
+    __sync_synchronize();
+    pins->inuse = 0;
+}
 
-    return true;
+static void
+mcdb_pins_key_create(void)
+{
+    if (pthread_key_create(&mcdb_pins_key, mcdb_pins_release) != 0)
+        mcdb_pins_key = (pthread_key_t)-1; /*(pins not used; use refcnt)*/
 }
 
-/* theaded programs (while multiple threads are using same struct mcdb_mmap)
- * must reopen and register (update refcnt on previous and new mcdb_mmap) while
- * holding a lock, or else there are race conditions with refcnt'ing. */
-bool  __attribute_noinline__
-mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
+/* acquire mcdb_pins for calling thread (malloc(), not map->fn_malloc, since
+ * called before loading shared mcdb_mmap ptr, when map might be reclaimed) */
+static struct mcdb_pins *  __attribute_noinline__
+mcdb_pins_acquire(void)
+{
+    struct mcdb_pins *pins;
+    if (pthread_once(&mcdb_pins_once, mcdb_pins_key_create) != 0
+        || mcdb_pins_key == (pthread_key_t)-1)
+        return NULL;
+    for (pins = mcdb_pins_list; pins != NULL; pins = pins->next) {
+        if (pins->inuse == 0 && __sync_bool_compare_and_swap(&pins->inuse,0,1))
+            break;
+    }
+    if (pins == NULL) {
+        if ((pins = malloc(sizeof(struct mcdb_pins))) == NULL)
+            return NULL;
+        memset(pins, '\0', sizeof(struct mcdb_pins));
+        pins->inuse = 1;
+        do {
+            pins->next = mcdb_pins_list;
+        } while (!__sync_bool_compare_and_swap(&mcdb_pins_list,
+                                               pins->next, pins));
+    }
+    if (pthread_setspecific(mcdb_pins_key, pins) != 0) {
+        pins->inuse = 0;
+        return NULL;
+    }
+    return (mcdb_pins_self = pins);
+}
+
+#define mcdb_pins_init() \
+  ((void)(__builtin_expect(mcdb_pins_self != NULL, true) || mcdb_pins_acquire()))
+
+/* pin map in calling thread's mcdb_pins (thread-local write)
+ * (caller must issue full memory barrier before relying on pin)
+ * (false if mcdb_pins full or not acquired by mcdb_pins_init()) */
+static bool
+mcdb_pin(struct mcdb_mmap * const map)
+{
+    struct mcdb_pins * const restrict pins = mcdb_pins_self;
+    uint32_t i, e = MCDB_PINS;
+    if (__builtin_expect(pins == NULL, false))
+        return false;
+    for (i = 0; i < MCDB_PINS; ++i) {
+        if (pins->map[i] == map) {
+            ++pins->cnt[i];
+            return true;
+        }
+        if (pins->map[i] == NULL && e == MCDB_PINS)
+            e = i;
+    }
+    if (e == MCDB_PINS)
+        return false;
+    pins->cnt[e] = 1;
+    pins->map[e] = map;
+    return true;
+}
+
+/* unpin map from calling thread's mcdb_pins (false if not pinned by thread) */
+static bool
+mcdb_unpin(const struct mcdb_mmap * const map)
+{
+    struct mcdb_pins * const restrict pins = mcdb_pins_self;
+    if (pins != NULL) {
+        for (uint32_t i = 0; i < MCDB_PINS; ++i) {
+            if (pins->map[i] == map) {
+                if (--pins->cnt[i] == 0)
+                    pins->map[i] = NULL;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* check if map is pinned by any thread (reclaim; holding mcdb_global_mutex) */
+static bool
+mcdb_pinned(const struct mcdb_mmap * const map)
+{
+    __sync_synchronize(); /*(pair w/ barrier after pin in registering thread)*/
+    for (const struct mcdb_pins *pins = mcdb_pins_list; pins; pins=pins->next){
+        for (uint32_t i = 0; i < MCDB_PINS; ++i) {
+            if (pins->map[i] == map)
+                return true;
+        }
+    }
+    return false;
+}
+
+#else  /* !_THREAD_SAFE */
+
+#define mcdb_pins_init() (void)0
+#define mcdb_pin(map)    false
+#define mcdb_unpin(map)  false
+#define mcdb_pinned(map) false
+
+#endif
+
+/* release reference held in map->refcnt (false if refcnt already 0) */
+static bool
+mcdb_refcnt_decr(struct mcdb_mmap * const map)
+{
+    uint32_t c;
+    do {
+        if ((c = map->refcnt) == 0)
+            return false;
+    } while (!__sync_bool_compare_and_swap(&map->refcnt, c, c-1));
+    return true;
+}
+
+/* release reference: thread pin, else map->refcnt (false if neither held) */
+#define mcdb_mmap_release(map) (mcdb_unpin(map) || mcdb_refcnt_decr(map))
+
+/* reclaim replaced mcdb_mmap, oldest first (holding mcdb_global_mutex)
+ * (map must be valid; caller holds reference or holds mutex since release) */
+static void  __attribute_noinline__
+mcdb_mmap_reclaim(struct mcdb_mmap * restrict map)
+{
+    struct mcdb_mmap *next;
+    while (map->prev != NULL)
+        map = map->prev;
+    while ((next = map->next) != NULL && map->refcnt == 0 && !mcdb_pinned(map)){
+        next->prev = NULL;
+        map->fname = NULL;  /* do not free(map->fname); shared with next */
+        mcdb_mmap_free(map);
+        map = next;
+    }
+}
+
+bool  __attribute_noinline__
+mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
+                              const int flags)
+{
+    struct mcdb_mmap *map;
+    struct mcdb_mmap *next;
+    const bool register_use_incr = ((flags & MCDB_REGISTER_USE_INCR) != 0);
+    /* (mutex is taken only if requested or to reclaim replaced mcdb_mmap) */
+    bool locked = ((flags & MCDB_REGISTER_MUTEX_UNLOCK_HOLD) != 0);
+
+    if ((flags & MCDB_REGISTER_MUTEX_LOCK_HOLD) && !locked) {
+        if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+            return false;
+        locked = true;
+    }
+
+    if (!register_use_incr) {
+        /*map = *mapptr;*/
+        map = *(struct mcdb_mmap * volatile * restrict)mapptr;
+        if (map != NULL) {
+            const bool slow = (map->next != NULL
+                               || (map->refcnt == 0 && map->prev == NULL
+                                   && !(flags & MCDB_REGISTER_MUNMAP_SKIP)));
+            if (slow && !locked) {
+                if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+                    return false;
+                locked = true;
+            }
+            (void)mcdb_mmap_release(map);
+            /* (map must not be accessed after release unless holding mutex)*/
+            if (!locked)
+                ;
+            else if (map->next != NULL)
+                mcdb_mmap_reclaim(map);
+            else if (slow && map->refcnt == 0 && !mcdb_pinned(map)) {
+                map->fname = NULL;    /* do not free(map->fname) yet */
+                mcdb_mmap_free(map);  /* last reference released */
+                *mapptr = NULL;
+            }
+        }
+    }
+    else {
+        mcdb_pins_init();
+        for (;;) {
+            map = *(struct mcdb_mmap * volatile * restrict)mapptr;
+            if (map == NULL)
+                break;
+            if (!mcdb_pin(map)) {
+                /* no pin; map might be reclaimed unless holding mutex */
+                if (!locked) {
+                    if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+                        return false;
+                    locked = true;
+                }
+                map = *(struct mcdb_mmap * volatile * restrict)mapptr;
+                if (map != NULL)
+                    __sync_fetch_and_add(&map->refcnt, 1);
+                break;
+            }
+            __sync_synchronize(); /* StoreLoad barrier: publish pin, recheck */
+            if (map == *(struct mcdb_mmap * volatile * restrict)mapptr)
+                break;
+            (void)mcdb_mmap_release(map); /* *mapptr changed; retry */
+        }
+        if (map == NULL || map->ptr == NULL) {
+            /* If registering, possibly detected race condition in which
+             * another thread released final reference and mcdb was munmap()'d.
+             * It is now invalid to attempt to register use of a resource that
+             * has been released.  Caller can detect and reopen */
+            if (map != NULL)
+                (void)mcdb_mmap_release(map);
+            if (locked && !(flags & MCDB_REGISTER_MUTEX_LOCK_HOLD))
+                pthread_mutex_unlock(&mcdb_global_mutex);
+            return false;
+        }
+        if ((next = map->next) != NULL) {
+            /* move registration to newest mcdb_mmap; release pin taken above
+             * and reference held on map via *mapptr */
+            while (next->next != NULL)
+                next = next->next;
+            if (!mcdb_pin(next))
+                __sync_fetch_and_add(&next->refcnt, 1);
+            /* (*mapptr already updated if shared *mapptr was reopened) */
+            const bool moved = __sync_bool_compare_and_swap(mapptr, map, next);
+            if (!locked) {
+                if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+                    return false; /*(leaves pins; map reclaimed later)*/
+                locked = true;
+            }
+            (void)mcdb_mmap_release(map);
+            if (moved)
+                (void)mcdb_mmap_release(map);
+            mcdb_mmap_reclaim(map);
+        }
+    }
+
+    if (locked && !(flags & MCDB_REGISTER_MUTEX_LOCK_HOLD))
+        pthread_mutex_unlock(&mcdb_global_mutex);
+
+    return true;
+}
+
+/* register use of mcdb_mmap currently referenced by shared *mapptr (without
+ * moving reference held via *mapptr) and return it; NULL if none
+ * (shared *mapptr must be updated only by mcdb_mmap_reopen_threadsafe()) */
+struct mcdb_mmap *  __attribute_noinline__
+mcdb_mmap_thread_register_shared(struct mcdb_mmap ** const restrict mapptr)
+{
+    struct mcdb_mmap *map;
+    mcdb_pins_init();
+    for (;;) {
+        map = *(struct mcdb_mmap * volatile * restrict)mapptr;
+        if (map == NULL)
+            return NULL;
+        if (!mcdb_pin(map)) {
+            /* no pin; map might be reclaimed unless holding mutex */
+            if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+                return NULL;
+            map = *(struct mcdb_mmap * volatile * restrict)mapptr;
+            if (map != NULL)
+                __sync_fetch_and_add(&map->refcnt, 1);
+            pthread_mutex_unlock(&mcdb_global_mutex);
+            if (map == NULL)
+                return NULL;
+            break;
+        }
+        __sync_synchronize(); /* StoreLoad barrier: publish pin, recheck */
+        if (map == *(struct mcdb_mmap * volatile * restrict)mapptr)
+            break;
+        (void)mcdb_mmap_release(map); /* *mapptr changed; retry */
+    }
+    if (map->ptr != NULL)
+        return map;
+    (void)mcdb_mmap_release(map);
+    return NULL;
+}
+
+/* theaded programs (while multiple threads are using same struct mcdb_mmap)
+ * must reopen while holding a lock; replaced mcdb_mmap is reclaimed once no
+ * longer referenced or pinned (see mcdb_mmap_thread_registration())
+ * (fd == -1 to reopen map->fname; else mmap fd (mcdb_mmap_reinit_threadsafe))*/
+static bool  __attribute_noinline__
+mcdb_mmap_replace_threadsafe(struct mcdb_mmap ** const restrict mapptr,
+                             const int fd)
 {
     bool rc = true;
 
@@ -597,7 +1857,7 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
         return false;
 
     if ((*mapptr)->next == NULL) {
-        const struct mcdb_mmap * const map = *mapptr;
+        struct mcdb_mmap * const map = *mapptr;
         struct mcdb_mmap *next;
         if (map->fn_malloc != NULL  /*(else caller misconfigured mcdb_mmap)*/
             && (next = map->fn_malloc(sizeof(struct mcdb_mmap))) != NULL) {
@@ -605,12 +1865,23 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
             next->ptr = NULL;       /*(skip munmap() in mcdb_mmap_reopen())*/
             if (map->fname == map->fnamebuf)
                 next->fname = next->fnamebuf;
-            if ((rc = mcdb_mmap_reopen(next))) {
-                next->hash_init = (*mapptr)->hash_init;
-                next->hash_fn   = (*mapptr)->hash_fn;
-                /* XXX: TODO should have StoreStore memory barrier here
-                 * (this matters only for custom hash functions) */
-                (*mapptr)->next = next;
+            if ((rc = fd == -1 ? mcdb_mmap_reopen(next)
+                               : mcdb_mmap_init(next, fd))) {
+                /* carry forward custom hash func (set by caller) only if
+                 * new mcdb does not specify a built-in hash func */
+                if (next->hash_id == MCDB_HASH_DJB
+                    && map->hash_fn != mcdb_hash_fn(map->hash_id)) {
+                    next->hash_init = map->hash_init;
+                    next->hash_fn   = map->hash_fn;
+                }
+                next->prev = map;
+                next->refcnt = 1;     /* move reference held via *mapptr */
+                (void)mcdb_refcnt_decr(map);
+                __sync_synchronize(); /* StoreStore: next init before publish*/
+                *mapptr = next;       /*(update *mapptr before map->next)*/
+                __sync_synchronize();
+                map->next = next;
+                mcdb_mmap_reclaim(map);
             }
             else
                 map->fn_free(next);
@@ -618,9 +1889,7 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
         else
             rc = false; /* map->fn_malloc failed */
     }
-    /* else rc = true;  (map->next already updated e.g. while obtaining lock) */
-
-    if (rc) {
+    else { /* (map->next already updated e.g. while obtaining lock) */
         const int mcdb_flags_hold_lock =
             MCDB_REGISTER_USE_INCR
           | MCDB_REGISTER_MUTEX_UNLOCK_HOLD
@@ -632,6 +1901,845 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
     return rc;
 }
 
+bool
+mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
+{
+    return mcdb_mmap_replace_threadsafe(mapptr, -1);
+}
+
+/* replace shared mcdb_mmap with mcdb in fd (e.g. updated mcdb received via
+ * mcdb_mmap_fd_recv()); caller closes fd (mcdb remains mapped) */
+bool
+mcdb_mmap_reinit_threadsafe(struct mcdb_mmap ** const restrict mapptr,
+                            const int fd)
+{
+    return mcdb_mmap_fd_sealed(fd)
+        && mcdb_mmap_replace_threadsafe(mapptr, fd);
+}
+
+
+/*
+ * Watch directory of mcdb for mcdb replaced (e.g. by mcdb_makefn_finish()
+ * rename() of temp file into place) and update mcdb_mmap in a background
+ * thread, so that querying threads need not call mcdb_mmap_refresh_check()
+ * (stat()) prior to queries; querying threads pick up updated mcdb_mmap via
+ * map->next in mcdb_thread_refresh_self() (no syscalls on query path)
+ *
+ * mapptr is shared mcdb_mmap ptr, as passed to mcdb_mmap_reopen_threadsafe(),
+ * and must remain valid until mcdb_mmap_unwatch()
+ */
+
+#if defined(_THREAD_SAFE) && defined(__linux__)
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <stdio.h>      /* snprintf() */
+
+struct mcdb_mmap_watch {
+  struct mcdb_mmap ** mapptr;
+  void (*fn_free)(void *);
+  pthread_t thread;
+  int ifd;                    /* inotify fd */
+  char fname[];               /* basename of mmap file */
+};
+
+static void *
+mcdb_mmap_watch_thread(void * const arg)
+{
+    struct mcdb_mmap_watch * const restrict w = arg;
+    union { struct inotify_event ev; char buf[4096]; } u;
+    struct pollfd pfd = { w->ifd, POLLIN, 0 };
+    const struct inotify_event *ev;
+    ssize_t r;
+    bool update;
+
+    /* thread is cancelled by mcdb_mmap_unwatch() only while in poll() */
+    (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    for (;;) {
+        (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        r = poll(&pfd, 1, -1);
+        (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        if (r == -1 && errno != EINTR)
+            break;
+        /* coalesce events read together into single mcdb_mmap update */
+        update = false;
+        while ((r = read(w->ifd, u.buf, sizeof(u.buf))) > 0) {
+            for (const char *p = u.buf; p < u.buf+r;
+                 p += sizeof(struct inotify_event) + ev->len) {
+                ev = (const struct inotify_event *)p;
+                if ((ev->mask & IN_Q_OVERFLOW)
+                    || (ev->len != 0 && strcmp(ev->name, w->fname) == 0))
+                    update = true;
+            }
+        }
+        if (r == -1 && errno != EAGAIN && errno != EINTR)
+            break;
+        if (update && !mcdb_mmap_reopen_threadsafe(w->mapptr))
+            continue; /* (retry upon next event in case of failure) */
+    }
+    return NULL;
+}
+
+struct mcdb_mmap_watch *  __attribute_noinline__
+mcdb_mmap_watch(struct mcdb_mmap ** const restrict mapptr)
+{
+    const struct mcdb_mmap * const restrict map = *mapptr;
+    struct mcdb_mmap_watch *w;
+    const char *fname = map->fname;
+    const char * const slash = strrchr(fname, '/');
+    char dname[PATH_MAX];
+    size_t flen;
+
+    /* watch dir referenced by map->dfd, else dir in map->fname, else "." */
+    if (map->dfd != -1)
+        snprintf(dname, sizeof(dname), "/proc/self/fd/%d", map->dfd);
+    else if (slash == NULL)
+        memcpy(dname, ".", 2);
+    else {
+        const size_t dlen = slash != fname ? (size_t)(slash - fname) : 1;
+        if (dlen >= sizeof(dname))
+            return (errno = ENAMETOOLONG, NULL);
+        memcpy(dname, fname, dlen);
+        dname[dlen] = '\0';
+    }
+    if (slash != NULL)
+        fname = slash+1;
+
+    flen = strlen(fname);
+    if (map->fn_malloc == NULL
+        || (w = map->fn_malloc(sizeof(struct mcdb_mmap_watch)+flen+1)) == NULL)
+        return NULL;
+    w->mapptr  = mapptr;
+    w->fn_free = map->fn_free;
+    memcpy(w->fname, fname, flen+1);
+
+    if ((w->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) != -1) {
+        if (inotify_add_watch(w->ifd, dname, IN_MOVED_TO | IN_CLOSE_WRITE
+                                           | IN_ONLYDIR) != -1) {
+            const int rc = pthread_create(&w->thread, NULL,
+                                          mcdb_mmap_watch_thread, w);
+            if (rc == 0)
+                return w;
+            errno = rc;
+        }
+        const int errsave = errno;
+        (void) nointr_close(w->ifd);
+        errno = errsave;
+    }
+    if (w->fn_free)
+        w->fn_free(w);
+    return NULL;
+}
+
+void
+mcdb_mmap_unwatch(struct mcdb_mmap_watch * const restrict w)
+{
+    if (w == NULL) return;
+    (void)pthread_cancel(w->thread);
+    (void)pthread_join(w->thread, NULL);
+    (void) nointr_close(w->ifd);
+    if (w->fn_free)
+        w->fn_free(w);
+}
+
+#else  /* !(_THREAD_SAFE && __linux__) */
+
+struct mcdb_mmap_watch *
+mcdb_mmap_watch(struct mcdb_mmap ** const restrict mapptr
+                __attribute_unused__)
+{
+    return (errno = ENOSYS, NULL);
+}
+
+void
+mcdb_mmap_unwatch(struct mcdb_mmap_watch * const restrict w
+                  __attribute_unused__)
+{
+}
+
+#endif
+
+
+/* helper thread pool faulting in mcdb pages for non-blocking lookups
+ * (completion fn(arg) is called from pool thread once page is faulted in) */
+#ifdef _THREAD_SAFE
+
+#include <stdlib.h>     /* malloc(), free() */
+
+struct mcdb_fault_req {
+  struct mcdb_fault_req *next;
+  struct mcdb_mmap *map;
+  uintptr_t pos;
+  void (*fn)(void *);
+  void *arg;
+};
+
+struct mcdb_fault_pool {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct mcdb_fault_req *head;
+  struct mcdb_fault_req **tail;
+  bool stop;
+  unsigned int nthreads;
+  pthread_t threads[];
+};
+
+static void *
+mcdb_fault_pool_thread(void * const arg)
+{
+    struct mcdb_fault_pool * const restrict pool = arg;
+    struct mcdb_fault_req *req;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while ((req = pool->head) == NULL && !pool->stop)
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        if (req != NULL && (pool->head = req->next) == NULL)
+            pool->tail = &pool->head;
+        pthread_mutex_unlock(&pool->mutex);
+        if (req == NULL)
+            break;  /* (stop; queue drained) */
+        /* fault in page; release reference on map taken by submit */
+        (void)*(volatile const unsigned char *)(req->map->ptr + req->pos);
+        (void)mcdb_mmap_thread_registration(&req->map, MCDB_REGISTER_USE_DECR);
+        req->fn(req->arg);
+        free(req);
+    }
+    return NULL;
+}
+
+struct mcdb_fault_pool *  __attribute_noinline__
+mcdb_fault_pool_create(const unsigned int nthreads)
+{
+    struct mcdb_fault_pool * restrict pool;
+    int rc = 0;
+    if (nthreads == 0)
+        return (errno = EINVAL, NULL);
+    if (nthreads > (SIZE_MAX - sizeof(struct mcdb_fault_pool))
+                   / sizeof(pthread_t))
+        return (errno = ENOMEM, NULL);
+    pool = malloc(sizeof(struct mcdb_fault_pool) + nthreads*sizeof(pthread_t));
+    if (pool == NULL)
+        return NULL;
+    pool->head = NULL;
+    pool->tail = &pool->head;
+    pool->stop = false;
+    pool->nthreads = 0;
+    if ((rc = pthread_mutex_init(&pool->mutex, NULL)) != 0) {
+        free(pool);
+        return (errno = rc, NULL);
+    }
+    if ((rc = pthread_cond_init(&pool->cond, NULL)) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return (errno = rc, NULL);
+    }
+    for (; pool->nthreads < nthreads; ++pool->nthreads) {
+        rc = pthread_create(&pool->threads[pool->nthreads], NULL,
+                            mcdb_fault_pool_thread, pool);
+        if (rc != 0) {
+            mcdb_fault_pool_destroy(pool);
+            return (errno = rc, NULL);
+        }
+    }
+    return pool;
+}
+
+void
+mcdb_fault_pool_destroy(struct mcdb_fault_pool * const restrict pool)
+{
+    /* pending requests are completed before pool threads exit */
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (unsigned int i = 0; i < pool->nthreads; ++i)
+        (void)pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+bool
+mcdb_fault_pool_submit(struct mcdb_fault_pool * const restrict pool,
+                       struct mcdb_mmap * const restrict map,
+                       const uintptr_t pos, void (* const fn)(void *),
+                       void * const arg)
+{
+    /* caller holds registration on map (map in use by caller's struct mcdb);
+     * take reference so that map stays mapped until page is faulted in */
+    struct mcdb_fault_req * const restrict req =
+      malloc(sizeof(struct mcdb_fault_req));
+    if (req == NULL)
+        return false;
+    if (pos >= map->size) {
+        free(req);
+        return (errno = EINVAL, false);
+    }
+    __sync_fetch_and_add(&map->refcnt, 1);
+    req->next = NULL;
+    req->map  = map;
+    req->pos  = pos;
+    req->fn   = fn;
+    req->arg  = arg;
+    pthread_mutex_lock(&pool->mutex);
+    *pool->tail = req;
+    pool->tail = &req->next;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+#else  /* !_THREAD_SAFE */
+
+struct mcdb_fault_pool *
+mcdb_fault_pool_create(const unsigned int nthreads __attribute_unused__)
+{
+    return (errno = ENOSYS, NULL);
+}
+
+void
+mcdb_fault_pool_destroy(struct mcdb_fault_pool * const restrict pool
+                        __attribute_unused__)
+{
+}
+
+bool
+mcdb_fault_pool_submit(struct mcdb_fault_pool * const restrict pool
+                         __attribute_unused__,
+                       struct mcdb_mmap * const restrict map
+                         __attribute_unused__,
+                       const uintptr_t pos __attribute_unused__,
+                       void (* const fn)(void *) __attribute_unused__,
+                       void * const arg __attribute_unused__)
+{
+    return (errno = ENOSYS, false);
+}
+
+#endif
+
+
+/*
+ * Bounded cache of many mcdb_mmap opened by name (relative to single dir)
+ *
+ * mcdb are opened (mmap'ed) on first mcdb_mmap_cache_get() of the name, and
+ * least-recently-used mcdb_mmap not in use are unmapped when number of maps
+ * or total mapped bytes would exceed limits.  Cache holds one directory fd
+ * shared by all of its mcdb_mmap (mcdb fd is closed once mmap'ed) and holds
+ * the reference from open in map->refcnt; mcdb_mmap_cache_get() registers
+ * caller's use with the same pins as mcdb_mmap_thread_register_shared(), and
+ * caller releases with mcdb_thread_unregister().  mcdb_mmap is evicted only if
+ * not referenced or pinned by any thread.  struct mcdb_mmap of evicted entries
+ * are reused for subsequently opened mcdb.
+ * (lock order: cache mutex, then mcdb_global_mutex)
+ */
+
+struct mcdb_mmap_cache_entry {
+  struct mcdb_mmap_cache_entry *hnext;    /* hash chain (or free list) */
+  struct mcdb_mmap_cache_entry *lprev;    /* LRU list (more recently used) */
+  struct mcdb_mmap_cache_entry *lnext;    /* LRU list (less recently used) */
+  struct mcdb_mmap *map;                  /* map->ptr NULL if on free list */
+  uint32_t h;                             /* hash of map->fname */
+};
+
+struct mcdb_mmap_cache {
+  struct mcdb_mmap_cache_entry **htab;    /* hash table (chained) */
+  struct mcdb_mmap_cache_entry *lru;      /* most recently used */
+  struct mcdb_mmap_cache_entry *lrutail;  /* least recently used */
+  struct mcdb_mmap_cache_entry *freelist; /* evicted entries for reuse */
+  void * (*fn_malloc)(size_t);
+  void (*fn_free)(void *);
+  uintptr_t bytes;                        /* total mapped bytes */
+  uintptr_t maxbytes;
+  uint32_t nmaps;                         /* num mapped entries */
+  uint32_t maxmaps;
+  uint32_t hmask;
+  int flags;                              /* (enum mcdb_mmap_flags) */
+  int dfd;                                /* fd open to dir; -1 if dname */
+  char *dname;                            /* dir prefix if no dfd; else NULL */
+ #ifdef _THREAD_SAFE
+  pthread_mutex_t mutex;
+ #endif
+};
+
+static void
+mcdb_mmap_cache_lru_unlink(struct mcdb_mmap_cache * const restrict cache,
+                           struct mcdb_mmap_cache_entry * const restrict e)
+{
+    if (e->lprev) e->lprev->lnext = e->lnext; else cache->lru     = e->lnext;
+    if (e->lnext) e->lnext->lprev = e->lprev; else cache->lrutail = e->lprev;
+}
+
+static void
+mcdb_mmap_cache_lru_push(struct mcdb_mmap_cache * const restrict cache,
+                         struct mcdb_mmap_cache_entry * const restrict e)
+{
+    e->lprev = NULL;
+    e->lnext = cache->lru;
+    if (cache->lru) cache->lru->lprev = e; else cache->lrutail = e;
+    cache->lru = e;
+}
+
+/* unmap mcdb of entry (and replaced mcdb_mmap) if not in use by any thread;
+ * leave struct mcdb_mmap allocated for reuse */
+static bool
+mcdb_mmap_cache_unmap(struct mcdb_mmap_cache_entry * const restrict e)
+{
+    struct mcdb_mmap * const restrict map = e->map;
+    if (pthread_mutex_lock(&mcdb_global_mutex) != 0)
+        return false;
+    /* (cache holds refcnt 1; replaced mcdb_mmap still in use if map->prev) */
+    const bool unused =
+      (map->refcnt == 1 && map->prev == NULL && !mcdb_pinned(map));
+    if (unused) {
+        mcdb_mmap_unmap(map);
+        map->refcnt = 0;
+    }
+    pthread_mutex_unlock(&mcdb_global_mutex);
+    return unused;
+}
+
+/* evict least-recently-used entries not in use until within limits
+ * (nmaps and bytes to be added for entry about to be mapped) */
+static bool
+mcdb_mmap_cache_evict(struct mcdb_mmap_cache * const restrict cache,
+                      const uint32_t nmaps, const uintptr_t bytes)
+{
+    struct mcdb_mmap_cache_entry *e = cache->lrutail;
+    struct mcdb_mmap_cache_entry *lprev;
+    struct mcdb_mmap_cache_entry **hp;
+    for (; e != NULL && (cache->nmaps + nmaps > cache->maxmaps
+                         || cache->bytes + bytes > cache->maxbytes); e = lprev){
+        lprev = e->lprev;
+        const uintptr_t size = e->map->size;
+        if (!mcdb_mmap_cache_unmap(e))
+            continue; /* in use */
+        mcdb_mmap_cache_lru_unlink(cache, e);
+        for (hp = &cache->htab[e->h & cache->hmask]; *hp != e; hp=&(*hp)->hnext)
+            ;
+        *hp = e->hnext;
+        e->hnext = cache->freelist;
+        cache->freelist = e;
+        --cache->nmaps;
+        cache->bytes -= size;
+    }
+    return (cache->nmaps + nmaps <= cache->maxmaps
+            && cache->bytes + bytes <= cache->maxbytes);
+}
+
+/* open mcdb into struct mcdb_mmap of entry (reused if previously evicted) */
+static bool
+mcdb_mmap_cache_open(struct mcdb_mmap_cache * const restrict cache,
+                     struct mcdb_mmap_cache_entry * const restrict e,
+                     const char * const restrict key, const size_t klen)
+{
+    struct mcdb_mmap * restrict map = e->map;
+    char *fbuf;
+    if (map == NULL) {
+        if ((map = cache->fn_malloc(sizeof(struct mcdb_mmap))) == NULL)
+            return false;
+        memset(map, '\0', sizeof(struct mcdb_mmap));
+        e->map = map;
+    }
+    else {
+        if (map->fname != NULL && map->fname != map->fnamebuf)
+            cache->fn_free(map->fname);
+        memset(map, '\0', sizeof(struct mcdb_mmap));
+    }
+    map->fn_malloc = cache->fn_malloc;
+    map->fn_free   = cache->fn_free;
+    map->dfd       = cache->dfd;
+    map->mflags    = (uint32_t)(cache->flags & ~MCDB_MMAP_CACHE_REFRESH);
+    if (sizeof(map->fnamebuf) > klen)
+        fbuf = map->fnamebuf;
+    else if ((fbuf = cache->fn_malloc(klen+1)) == NULL)
+        return false;
+    memcpy(fbuf, key, klen+1);
+    map->fname = fbuf;
+    if (!mcdb_mmap_reopen(map))
+        return false;
+    map->refcnt = 1;  /* reference held by cache */
+    return true;
+}
+
+__attribute_noinline__
+struct mcdb_mmap_cache *
+mcdb_mmap_cache_create(const char * const dname,
+                       const uint32_t maxmaps, const uintptr_t maxbytes,
+                       const int flags,
+                       void * (*fn_malloc)(size_t), void (*fn_free)(void *))
+{
+    struct mcdb_mmap_cache *cache;
+    uint32_t hsz = 16;
+    if (maxmaps == 0 || maxbytes == 0)
+        return (errno = EINVAL, NULL);
+    while (hsz < maxmaps && hsz < (1u << 20))
+        hsz <<= 1;
+    if ((cache = fn_malloc(sizeof(struct mcdb_mmap_cache))) == NULL)
+        return NULL;
+    memset(cache, '\0', sizeof(struct mcdb_mmap_cache));
+    cache->fn_malloc = fn_malloc;
+    cache->fn_free   = fn_free;
+    cache->maxmaps   = maxmaps;
+    cache->maxbytes  = maxbytes;
+    cache->hmask     = hsz - 1;
+    cache->flags     = flags;
+    cache->dfd       = -1;
+    if ((cache->htab = fn_malloc(hsz * sizeof(*cache->htab))) == NULL) {
+        fn_free(cache);
+        return NULL;
+    }
+    memset(cache->htab, '\0', hsz * sizeof(*cache->htab));
+  #ifdef _THREAD_SAFE
+    if (pthread_mutex_init(&cache->mutex, NULL) != 0) {
+        fn_free(cache->htab);
+        fn_free(cache);
+        return NULL;
+    }
+  #endif
+    if (dname != NULL) {
+      #if defined(__linux__) || defined(__sun)
+        /* caller must have open STDIN, STDOUT, STDERR */
+        cache->dfd = nointr_open(dname, O_RDONLY|O_CLOEXEC, 0);
+        if (cache->dfd > STDERR_FILENO) {
+            if (O_CLOEXEC == 0)
+                (void) fcntl(cache->dfd, F_SETFD, FD_CLOEXEC);
+        }
+        else {
+            mcdb_mmap_cache_destroy(cache);
+            return NULL;
+        }
+      #else
+        const size_t dlen = strlen(dname);
+        if ((cache->dname = fn_malloc(dlen+1)) == NULL) {
+            mcdb_mmap_cache_destroy(cache);
+            return NULL;
+        }
+        memcpy(cache->dname, dname, dlen+1);
+      #endif
+    }
+    return cache;
+}
+
+void  __attribute_noinline__
+mcdb_mmap_cache_destroy(struct mcdb_mmap_cache * const restrict cache)
+{
+    /* (caller must have released all mcdb_mmap obtained from cache) */
+    struct mcdb_mmap_cache_entry *e;
+    if (cache == NULL) return;
+    for (e = cache->lru; e != NULL; e = e->lnext) {
+        e->hnext = cache->freelist;
+        cache->freelist = e;
+    }
+    while ((e = cache->freelist) != NULL) {
+        cache->freelist = e->hnext;
+        if (e->map != NULL) {
+            e->map->dfd = -1;   /* do not close cache->dfd */
+            mcdb_mmap_destroy(e->map);
+        }
+        cache->fn_free(e);
+    }
+    if (cache->dfd != -1)
+        (void) nointr_close(cache->dfd);
+    if (cache->dname != NULL)
+        cache->fn_free(cache->dname);
+  #ifdef _THREAD_SAFE
+    pthread_mutex_destroy(&cache->mutex);
+  #endif
+    cache->fn_free(cache->htab);
+    cache->fn_free(cache);
+}
+
+/* get registered mcdb_mmap for fname, opening mcdb (and evicting LRU mcdb not
+ * in use) if not already cached (caller releases with mcdb_thread_unregister())
+ * (NULL w/ errno EBUSY if limits reached and all cached mcdb_mmap are in use)*/
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_cache_get(struct mcdb_mmap_cache * const restrict cache,
+                    const char * const restrict fname)
+{
+    struct mcdb_mmap_cache_entry *e;
+    struct mcdb_mmap *map = NULL;
+    char buf[PATH_MAX];
+    const char *key = fname;
+    size_t klen = strlen(fname);
+    uint32_t h;
+
+    if (cache->dname != NULL) {
+        const size_t dlen = strlen(cache->dname);
+        if (dlen + klen + 2 > sizeof(buf))
+            return (errno = ENAMETOOLONG, NULL);
+        memcpy(buf, cache->dname, dlen);
+        buf[dlen] = '/';
+        memcpy(buf+dlen+1, fname, klen+1);
+        key = buf;
+        klen += dlen + 1;
+    }
+    h = uint32_hash_djb(UINT32_HASH_DJB_INIT, key, klen);
+
+    if (pthread_mutex_lock(&cache->mutex) != 0)
+        return NULL;
+
+    for (e = cache->htab[h & cache->hmask]; e != NULL; e = e->hnext) {
+        if (e->h == h && strcmp(e->map->fname, key) == 0)
+            break;
+    }
+    if (e != NULL) {
+        mcdb_mmap_cache_lru_unlink(cache, e);
+        if ((cache->flags & MCDB_MMAP_CACHE_REFRESH)
+            && mcdb_mmap_refresh_check(e->map)) {
+            const uintptr_t size = e->map->size;
+            if (mcdb_mmap_reopen_threadsafe(&e->map))
+                cache->bytes = cache->bytes - size + e->map->size;
+        }
+    }
+    else {
+        const int errsave = errno;
+        if (!mcdb_mmap_cache_evict(cache, 1, 0)) {
+            pthread_mutex_unlock(&cache->mutex);
+            return (errno = EBUSY, NULL);
+        }
+        errno = errsave;
+        if ((e = cache->freelist) != NULL)
+            cache->freelist = e->hnext;
+        else if ((e = cache->fn_malloc(sizeof(*e))) != NULL)
+            e->map = NULL;
+        else {
+            pthread_mutex_unlock(&cache->mutex);
+            return NULL;
+        }
+        if (!mcdb_mmap_cache_open(cache, e, key, klen)) {
+            const int errnum = errno;
+            e->hnext = cache->freelist;
+            cache->freelist = e;
+            pthread_mutex_unlock(&cache->mutex);
+            return (errno = errnum, NULL);
+        }
+        /* (mcdb size known only once mapped; limit total bytes mapped) */
+        if (!mcdb_mmap_cache_evict(cache, 1, e->map->size)) {
+            const int errnum = e->map->size > cache->maxbytes ? EFBIG : EBUSY;
+            mcdb_mmap_unmap(e->map);
+            e->map->refcnt = 0;
+            e->hnext = cache->freelist;
+            cache->freelist = e;
+            pthread_mutex_unlock(&cache->mutex);
+            return (errno = errnum, NULL);
+        }
+        e->h = h;
+        e->hnext = cache->htab[h & cache->hmask];
+        cache->htab[h & cache->hmask] = e;
+        ++cache->nmaps;
+        cache->bytes += e->map->size;
+    }
+    mcdb_mmap_cache_lru_push(cache, e);
+    map = mcdb_mmap_thread_register_shared(&e->map);
+
+    pthread_mutex_unlock(&cache->mutex);
+    return map;
+}
+
+
+
+/*
+ * Hot page record/replay
+ *
+ * mcdb_mmap_hot_save() records which pages of mcdb are resident in memory
+ * (mincore()) to file named mcdb fname + ".hot" next to mcdb (replaced
+ * atomically).  Called periodically, e.g. from maintenance thread, each save
+ * snapshots current working set.  mcdb_mmap_hot_replay() reads recording and
+ * asks operating system to read recorded pages in (posix_madvise() WILLNEED,
+ * which does not wait for reads), so that a cold start prefetches only the
+ * working set instead of entire mcdb (mcdb_mmap_prefault()).
+ * Recording: 16-byte header (big-endian 4-byte magic, page size, mcdb size
+ * high and low 32 bits) followed by bitmap of resident pages.  Recording of a
+ * different mcdb size or page size is ignored (ESTALE); it is only a hint.
+ * (ENOSYS if mincore() not available)
+ */
+
+#include <stdio.h>      /* rename(), renameat() */
+
+#define MCDB_HOT_MAGIC 0x6d636468u  /* "mcdh" */
+#define MCDB_HOT_HDRSZ 16
+
+static size_t
+mcdb_mmap_hot_fname(const struct mcdb_mmap * const restrict map,
+                    char * const restrict buf, const size_t bufsz,
+                    const char * const restrict suffix)
+{
+    const size_t flen = strlen(map->fname);
+    const size_t slen = strlen(suffix);
+    if (flen == 0 || flen + slen >= bufsz)
+        return (errno = flen ? ENAMETOOLONG : EINVAL, 0);
+    memcpy(buf, map->fname, flen);
+    memcpy(buf+flen, suffix, slen+1);
+    return flen + slen;
+}
+
+static int
+mcdb_mmap_hot_open(const struct mcdb_mmap * const restrict map,
+                   const char * const restrict fn, const int oflags)
+{
+  #ifdef AT_FDCWD
+    if (map->dfd != -1)
+        return nointr_openat(map->dfd, fn, oflags, S_IRUSR|S_IWUSR);
+  #endif
+    return nointr_open(fn, oflags, S_IRUSR|S_IWUSR);
+}
+
+bool  __attribute_noinline__
+mcdb_mmap_hot_save(const struct mcdb_mmap * const restrict map)
+{
+  #ifdef MCDB_MINCORE
+    const long pgsz = sysconf(_SC_PAGESIZE);
+    const uintptr_t psz = pgsz > 0 ? (uintptr_t)pgsz : 4096;
+    const uintptr_t npages = (map->size + psz - 1) / psz;
+    const size_t bsz = MCDB_HOT_HDRSZ + (size_t)((npages + 7) >> 3);
+    unsigned char vec[4096];
+    unsigned char *bits;
+    char fn[PATH_MAX];
+    char fntmp[PATH_MAX];
+    uintptr_t pg, n, i;
+    size_t len;
+    pid_t pid = getpid();
+    int fd;
+    bool rc;
+
+    if (map->ptr == NULL)
+        return (errno = EINVAL, false);
+    if (!mcdb_mmap_hot_fname(map, fn, sizeof(fn), ".hot")
+        || (len = mcdb_mmap_hot_fname(map, fntmp, sizeof(fntmp)-24,
+                                      ".hot.tmp")) == 0)
+        return false;
+    do { fntmp[len++] = (char)('0' + pid % 10); } while ((pid /= 10) != 0);
+    fntmp[len] = '\0';
+
+    if (map->fn_malloc == NULL || (bits = map->fn_malloc(bsz)) == NULL)
+        return false;
+    memset(bits, '\0', bsz);
+    uint32_strpack_bigendian_macro(bits,    MCDB_HOT_MAGIC);
+    uint32_strpack_bigendian_macro(bits+4,  (uint32_t)psz);
+    uint32_strpack_bigendian_macro(bits+8,  (uint32_t)((uint64_t)map->size>>32));
+    uint32_strpack_bigendian_macro(bits+12, (uint32_t)map->size);
+    for (pg = 0; pg < npages; pg += n) {
+        n = npages - pg < sizeof(vec) ? npages - pg : sizeof(vec);
+        if (mincore(map->ptr + pg * psz, n * psz, (void *)vec) != 0) {
+            const int errsave = errno;
+            map->fn_free(bits);
+            return (errno = errsave, false);
+        }
+        for (i = 0; i < n; ++i) {
+            if (vec[i] & 1)
+                bits[MCDB_HOT_HDRSZ + ((pg+i) >> 3)] |= 1u << ((pg+i) & 7);
+        }
+    }
+
+    fd = mcdb_mmap_hot_open(map, fntmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC);
+    rc = (fd != -1
+          && nointr_write(fd, (char *)bits, bsz) != -1
+          && nointr_close(fd) == 0
+          && (fd = -1,
+            #ifdef AT_FDCWD
+              map->dfd != -1
+                ? renameat(map->dfd, fntmp, map->dfd, fn) == 0
+                :
+            #endif
+                  rename(fntmp, fn) == 0));
+    if (!rc) {
+        const int errsave = errno;
+        if (fd != -1)
+            (void) nointr_close(fd);
+      #ifdef AT_FDCWD
+        if (map->dfd != -1)
+            (void) unlinkat(map->dfd, fntmp, 0);
+        else
+      #endif
+            (void) unlink(fntmp);
+        errno = errsave;
+    }
+    map->fn_free(bits);
+    return rc;
+  #else
+    (void)map;
+    return (errno = ENOSYS, false);
+  #endif
+}
+
+/* posix_madvise() WILLNEED run of recorded pages [pg, end) */
+static void
+mcdb_mmap_hot_willneed(const struct mcdb_mmap * const restrict map,
+                       const uintptr_t pg, const uintptr_t end,
+                       const uintptr_t psz)
+{
+    posix_madvise(map->ptr + pg * psz, (size_t)((end - pg) * psz),
+                  POSIX_MADV_WILLNEED);
+}
+
+bool  __attribute_noinline__
+mcdb_mmap_hot_replay(struct mcdb_mmap * const restrict map)
+{
+    const long pgsz = sysconf(_SC_PAGESIZE);
+    const uintptr_t psz = pgsz > 0 ? (uintptr_t)pgsz : 4096;
+    const uintptr_t npages = (map->size + psz - 1) / psz;
+    const size_t bsz = (size_t)((npages + 7) >> 3);
+    unsigned char hdr[MCDB_HOT_HDRSZ];
+    unsigned char bits[4096];
+    char fn[PATH_MAX];
+    uintptr_t pg = 0, run = npages; /* (run: first page of run; npages if none)*/
+    ssize_t rd;
+    size_t len = 0, off, n, i;
+    int fd;
+
+    if (map->ptr == NULL)
+        return (errno = EINVAL, false);
+    if (map->mflags & (MCDB_MMAP_POPULATE|MCDB_MMAP_MLOCK|MCDB_MMAP_HUGEPAGE))
+        return true; /* (already resident) */
+    if (!mcdb_mmap_hot_fname(map, fn, sizeof(fn), ".hot"))
+        return false;
+    if ((fd = mcdb_mmap_hot_open(map, fn, O_RDONLY|O_CLOEXEC)) == -1)
+        return false;
+    do {
+        rd = read(fd, hdr+len, sizeof(hdr)-len);
+    } while (rd > 0 ? (len += (size_t)rd) < sizeof(hdr)
+                    : rd == -1 && errno == EINTR);
+    if (len != sizeof(hdr)
+        || uint32_strunpack_bigendian_macro(hdr)    != MCDB_HOT_MAGIC
+        || uint32_strunpack_bigendian_macro(hdr+4)  != (uint32_t)psz
+        || uint32_strunpack_bigendian_macro(hdr+8)
+             != (uint32_t)((uint64_t)map->size >> 32)
+        || uint32_strunpack_bigendian_macro(hdr+12) != (uint32_t)map->size) {
+        (void) close(fd);
+        return (errno = ESTALE, false);
+    }
+    /* read bitmap in chunks; posix_madvise() WILLNEED each run of recorded
+     * pages as it ends (does not block; operating system reads pages in) */
+    for (off = 0; off < bsz; off += n) {
+        n = bsz - off < sizeof(bits) ? bsz - off : sizeof(bits);
+        for (len = 0; len < n; len += (size_t)rd) {
+            if ((rd = read(fd, bits+len, n-len)) <= 0) {
+                if (rd == -1 && errno == EINTR) { rd = 0; continue; }
+                const int errsave = rd == 0 ? ESTALE : errno;
+                (void) close(fd);
+                return (errno = errsave, false);
+            }
+        }
+        for (i = 0; i < (n << 3) && pg < npages; ++i, ++pg) {
+            if (bits[i >> 3] & (1u << (i & 7))) {
+                if (run == npages)
+                    run = pg;
+            }
+            else if (run != npages) {
+                mcdb_mmap_hot_willneed(map, run, pg, psz);
+                run = npages;
+            }
+        }
+    }
+    if (run != npages)
+        mcdb_mmap_hot_willneed(map, run, npages, psz);
+    (void) close(fd);
+    return true;
+}
+
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
@@ -663,6 +2771,9 @@ HIDDEN extern __typeof (mcdb_mmap_refresh_check)
 HIDDEN extern __typeof (mcdb_mmap_thread_registration)
                         mcdb_mmap_thread_registration_h
   __attribute__((alias ("mcdb_mmap_thread_registration")));
+HIDDEN extern __typeof (mcdb_mmap_thread_register_shared)
+                        mcdb_mmap_thread_register_shared_h
+  __attribute__((alias ("mcdb_mmap_thread_register_shared")));
 HIDDEN extern __typeof (mcdb_mmap_reopen_threadsafe)
                         mcdb_mmap_reopen_threadsafe_h
   __attribute__((alias ("mcdb_mmap_reopen_threadsafe")));
@@ -38,6 +38,7 @@
 
 #include <stdint.h>   /* uint32_t, uintptr_t */
 #include <unistd.h>   /* size_t   */
+#include <sys/types.h>/* dev_t, ino_t */
 #include <sys/time.h> /* time_t   */
 
 #ifndef __cplusplus
@@ -80,14 +81,25 @@ struct mcdb_mmap {
   uint32_t b;                 /* hash table stride bits: (data < 4GB) ? 3 : 4 */
   uint32_t n;                 /* num records in mcdb */
   uint32_t hash_init;         /* hash init value */
-  uint32_t hash_pad;          /* (padding)*/
+  uint32_t hash_id;           /* hash func id (enum mcdb_hash_id) */
+  uint32_t version;           /* mcdb format version (1 if no v2 header) */
+  uint32_t flags;             /* feature flags (enum mcdb_hdr_flags) */
+  uint32_t slot_bits;         /* lvl1 slot bits (MCDB_SLOT_BITS by default) */
+  uint32_t mflags;            /* mmap flags (enum mcdb_mmap_flags) */
   uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
   uintptr_t size;             /* mmap size */
+  uintptr_t eod;              /* end of data records (0 if no v2 header) */
+  uintptr_t slots;            /* offset of lvl1 slot table (0: header) */
+  uint64_t gen;               /* mcdb generation (0 if not set by creator) */
   time_t mtime;               /* mmap file mtime */
+  long mtime_nsec;            /* mmap file mtime nanoseconds (0 if n/a) */
+  ino_t ino;                  /* mmap file inode */
+  dev_t dev;                  /* mmap file device */
   struct mcdb_mmap * volatile next;    /* updated (new) mcdb_mmap */
+  struct mcdb_mmap *prev;              /* replaced mcdb_mmap (not reclaimed) */
   void * (*fn_malloc)(size_t);         /* fn ptr to malloc() */
   void (*fn_free)(void *);             /* fn ptr to free() */
-  volatile uint32_t refcnt;            /* registered access reference count */
+  volatile uint32_t refcnt;            /* references not pinned by a thread */
   int dfd;                    /* fd open to dir in which mmap file resides */
   char *fname;                /* basename of mmap file, relative to dir fd */
   char fnamebuf[64];          /* buffer in which to store short fname */
@@ -103,7 +115,7 @@ struct mcdb {
   uint32_t dlen;   /* initialized if mcdb_findtagnext() returns true */
   uint32_t klen;   /* initialized if mcdb_findtagnext() returns true */
   uint32_t khash;  /* initialized by call to mcdb_findtagstart() */
-  uint32_t pad0;   /* padding */
+  uint32_t kfp;    /* key fingerprint (MCDB_FLAG_KEYFP); ~0 until computed */
   void *vp;        /* user-provided extension data */
 };
 
@@ -124,6 +136,64 @@ mcdb_findtagnext(struct mcdb * restrict, const char * restrict, size_t,
   (__builtin_expect((mcdb_findstart((m),(key),(klen))), 1) \
                   && mcdb_findnext((m),(key),(klen)))
 
+/* batch lookup of n keys; m is array of n struct mcdb, each with map set.
+ * Each m[i] is left in same state as after mcdb_find(&m[i],keys[i],klens[i])
+ * (m[i] found if mcdb_findmany_found(&m[i]); mcdb_findnext() for next dup)
+ * Returns number of keys found. */
+extern size_t
+mcdb_findtagmany(struct mcdb * restrict, size_t,
+                 const char * const * restrict, const size_t * restrict,
+                 unsigned char)/* note: must be 0 or cast to (unsigned char) */
+  __attribute_nonnull__  __attribute_hot__  __attribute_nothrow__;
+
+#define mcdb_findmany(m,n,keys,klens) \
+  mcdb_findtagmany((m),(n),(keys),(klens),0)
+#define mcdb_findmany_found(m)     ((m)->loop != 0)
+
+/* non-blocking lookup (e.g. for event loop): same as mcdb_findtagstart() and
+ * mcdb_findtagnext(), but returns MCDB_TRY_WOULDBLOCK instead of accessing an
+ * mcdb page which is not resident in memory (major page fault), setting *pos
+ * to offset of page in mcdb.  Caller fetches page, e.g. with
+ * mcdb_fault_pool_submit(), and then repeats the same call.  Upon
+ * MCDB_TRY_FOUND from mcdb_findtagtrynext(), key and value are resident. */
+enum mcdb_try {
+  MCDB_TRY_WOULDBLOCK = -1,
+  MCDB_TRY_NOTFOUND   =  0,
+  MCDB_TRY_FOUND      =  1
+};
+extern int
+mcdb_findtagtrystart(struct mcdb * restrict, const char * restrict, size_t,
+                     unsigned char, uintptr_t * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+extern int
+mcdb_findtagtrynext(struct mcdb * restrict, const char * restrict, size_t,
+                    unsigned char, uintptr_t * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
+#define mcdb_findtrystart(m,key,klen,pos) \
+  mcdb_findtagtrystart((m),(key),(klen),0,(pos))
+#define mcdb_findtrynext(m,key,klen,pos) \
+  mcdb_findtagtrynext((m),(key),(klen),0,(pos))
+
+/* helper thread pool which faults in mcdb page at pos, then calls fn(arg)
+ * from pool thread (e.g. to wake event loop to repeat non-blocking lookup).
+ * map must be registered by caller (in use) when calling submit.
+ * mcdb_fault_pool_destroy() completes pending requests before returning.
+ * (EINVAL if nthreads is 0; ENOSYS if not compiled _THREAD_SAFE) */
+struct mcdb_fault_pool;
+extern struct mcdb_fault_pool *
+mcdb_fault_pool_create(unsigned int)
+  __attribute_warn_unused_result__;
+extern void
+mcdb_fault_pool_destroy(struct mcdb_fault_pool * restrict);
+extern bool
+mcdb_fault_pool_submit(struct mcdb_fault_pool * restrict,
+                       struct mcdb_mmap * restrict, uintptr_t,
+                       void (*)(void *), void *)
+  __attribute_nonnull_x__((1,2,4))  __attribute_warn_unused_result__;
+
 extern void *
 mcdb_read(const struct mcdb * restrict, uintptr_t, uint32_t, void * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
@@ -174,6 +244,60 @@ mcdb_mmap_create(struct mcdb_mmap * restrict,
 extern void
 mcdb_mmap_destroy(struct mcdb_mmap * restrict)
   ;
+/* mmap flags (kept in map->mflags and applied again when mcdb is reopened)
+ * MCDB_MMAP_POPULATE:    read entire mcdb into memory at open (MAP_POPULATE)
+ * MCDB_MMAP_MLOCK:       lock entire mcdb in memory (mlock())
+ * MCDB_MMAP_MLOCK_INDEX: lock header and lvl2 hash tables in memory, so that
+ *                        lookup incurs at most one major fault (data record)
+ * MCDB_MMAP_HUGEPAGE:    copy mcdb into anonymous memory backed by transparent
+ *                        huge pages (fewer TLB misses for large, hot mcdb)
+ * MCDB_MMAP_CACHE_REFRESH: (mcdb_mmap_cache_create() only) check for updated
+ *                        mcdb (stat()) upon each mcdb_mmap_cache_get()
+ * (mcdb_mmap_init() fails if mlock() fails, e.g. RLIMIT_MEMLOCK exceeded) */
+enum mcdb_mmap_flags {
+  MCDB_MMAP_POPULATE    = 1,
+  MCDB_MMAP_MLOCK       = 2,
+  MCDB_MMAP_MLOCK_INDEX = 4,
+  MCDB_MMAP_HUGEPAGE    = 8,
+  MCDB_MMAP_CACHE_REFRESH = 16
+};
+extern struct mcdb_mmap *  __attribute_malloc__
+mcdb_mmap_create_flags(struct mcdb_mmap * restrict,
+                       const char *,const char *,void * (*)(size_t),
+                       void (*)(void *), int)
+  __attribute_nonnull_x__((3,4,5))  __attribute_warn_unused_result__;
+/* mcdb_mmap of mcdb in fd, e.g. sealed memfd (mcdb_makefn_memfd_finish())
+ * received from another process (mcdb_mmap_fd_recv()) over UNIX socket.
+ * memfd must be sealed against shrink and write (else EPERM).
+ * Caller closes fd after create (mcdb remains mapped).  Threaded programs
+ * update shared mcdb_mmap ptr w/ mcdb_mmap_reinit_threadsafe() and new fd. */
+extern struct mcdb_mmap *  __attribute_malloc__
+mcdb_mmap_create_fd(struct mcdb_mmap * restrict, int,
+                    void * (*)(size_t), void (*)(void *), int)
+  __attribute_nonnull_x__((3,4))  __attribute_warn_unused_result__;
+extern int
+mcdb_mmap_fd_recv(int)
+  __attribute_warn_unused_result__;
+/* bounded cache of mcdb_mmap opened by name (fname relative to dname) on
+ * demand, limited to maxmaps mcdb_mmap and maxbytes total mapped bytes;
+ * least-recently-used mcdb_mmap not in use are evicted (munmap()) and their
+ * struct mcdb_mmap reused.  flags (enum mcdb_mmap_flags) apply to each mcdb.
+ * mcdb_mmap_cache_get() returns mcdb_mmap registered for use by caller
+ * (m->map = mcdb_mmap_cache_get(...)); caller releases with
+ * mcdb_thread_unregister(m).  NULL w/ errno EBUSY if limits reached and all
+ * cached mcdb_mmap are in use; EFBIG if mcdb larger than maxbytes.
+ * mcdb_mmap_cache_destroy() requires all mcdb_mmap to have been released. */
+struct mcdb_mmap_cache;
+extern struct mcdb_mmap_cache *
+mcdb_mmap_cache_create(const char *, uint32_t, uintptr_t, int,
+                       void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull_x__((5,6))  __attribute_warn_unused_result__;
+extern void
+mcdb_mmap_cache_destroy(struct mcdb_mmap_cache * restrict)
+  ;
+extern struct mcdb_mmap *
+mcdb_mmap_cache_get(struct mcdb_mmap_cache * restrict, const char * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 /* check if constant db has been updated and refresh mmap
  * (for use with mcdb mmaps held open for any period of time)
  * (i.e. for any use other than mcdb_mmap_create(), query, mcdb_mmap_destroy())
@@ -198,6 +322,16 @@ mcdb_mmap_prefault(const struct mcdb_mmap * restrict)
 extern void
 mcdb_mmap_free(struct mcdb_mmap * restrict)
   ;
+/* hot page record/replay: mcdb_mmap_hot_save() records pages of mcdb resident
+ * in memory (mincore()) to fname + ".hot" next to mcdb (call periodically);
+ * mcdb_mmap_hot_replay() prefetches recorded pages (posix_madvise() WILLNEED;
+ * does not block) (e.g. upon open after reboot or failover) */
+extern bool
+mcdb_mmap_hot_save(const struct mcdb_mmap * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+extern bool
+mcdb_mmap_hot_replay(struct mcdb_mmap * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 extern bool
 mcdb_mmap_reopen(struct mcdb_mmap * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
@@ -219,9 +353,24 @@ enum mcdb_flags {
 extern bool
 mcdb_mmap_thread_registration(struct mcdb_mmap ** restrict, int)
   __attribute_nonnull__;
+extern struct mcdb_mmap *
+mcdb_mmap_thread_register_shared(struct mcdb_mmap ** restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 extern bool
 mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
+extern bool
+mcdb_mmap_reinit_threadsafe(struct mcdb_mmap ** restrict, int)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* watch for updated mcdb in background thread (Linux inotify; else ENOSYS)
+ * (alternative to (periodically) calling mcdb_mmap_refresh_threadsafe()) */
+struct mcdb_mmap_watch;
+extern struct mcdb_mmap_watch *
+mcdb_mmap_watch(struct mcdb_mmap ** restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+extern void
+mcdb_mmap_unwatch(struct mcdb_mmap_watch * restrict);
 
 
 #define mcdb_thread_register(mcdb) \
@@ -245,6 +394,107 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** restrict)
 #define MCDB_PAD_ALIGN 16
 #define MCDB_PAD_MASK (MCDB_PAD_ALIGN-1)
 
+/* mcdb header fields
+ * Each 16-byte lvl1 slot header contains 8-byte hpos, 4-byte hslots, and
+ * 4 bytes of padding.  The padding is used to store (optional) header fields,
+ * 4-byte big-endian values, one per slot header.  Fields are 0 if not set,
+ * as in mcdb created prior to addition of header fields.  (Earlier versions
+ * of mcdb ignore the padding and are unable to detect non-default settings.)*/
+enum mcdb_hdr_field {
+  MCDB_HDR_HASH_ID = 0,       /* hash func id (enum mcdb_hash_id) */
+  MCDB_HDR_HASH_INIT,         /* hash init value (seed); ignored for djb */
+  MCDB_HDR_MAGIC,             /* MCDB_HDR_MAGIC_V2 if v2 header fields present */
+  MCDB_HDR_VERSION,           /* mcdb format version */
+  MCDB_HDR_FLAGS,             /* feature flags (enum mcdb_hdr_flags) */
+  MCDB_HDR_B,                 /* hash table stride bits (3 or 4) */
+  MCDB_HDR_NRECS,             /* num records in mcdb */
+  MCDB_HDR_EOD_HI,            /* end of data records (high 32 bits) */
+  MCDB_HDR_EOD_LO,            /* end of data records (low 32 bits) */
+  MCDB_HDR_SLOT_BITS,         /* lvl1 slot bits (MCDB_FLAG_SLOTS) */
+  MCDB_HDR_GEN_HI,            /* mcdb generation (high 32 bits) */
+  MCDB_HDR_GEN_LO             /* mcdb generation (low 32 bits) */
+};
+#define mcdb_hdr_field_offset(f) ((((uint32_t)(f))<<4)+12)
+
+/* v2 header fields are valid only if MCDB_HDR_MAGIC is MCDB_HDR_MAGIC_V2
+ * (mcdb created prior to v2 header have 0 in all header fields) */
+#define MCDB_HDR_MAGIC_V2 0x6d636462u /* "mcdb" */
+#define MCDB_VERSION 2u
+
+/* feature flags: reader must recognize all flags set in mcdb (else ENOTSUP)*/
+enum mcdb_hdr_flags {
+  MCDB_FLAGS_NONE = 0,
+  MCDB_FLAG_KEYFP = 1,  /* 16-byte lvl2 entries w/ klen, 16-bit key fingerprint
+                         * in high bits of 64-bit dpos (dpos limited to 48 bits)
+                         * (false khash matches rejected w/o reading data) */
+  MCDB_FLAG_MPH   = 2,  /* lvl2 minimal perfect hash index instead of open hash
+                         * table (keys must be unique) */
+  MCDB_FLAG_SWISS = 4,  /* lvl2 hash table of 64-byte groups w/ control bytes */
+  MCDB_FLAG_SLOTS = 8   /* lvl1 slot table of 2^MCDB_HDR_SLOT_BITS slots
+                         * following lvl2 hash tables (see below) */
+};
+#define MCDB_FLAGS_KNOWN \
+  (MCDB_FLAG_KEYFP|MCDB_FLAG_MPH|MCDB_FLAG_SWISS|MCDB_FLAG_SLOTS)
+#define MCDB_FLAGS_LAYOUT (MCDB_FLAG_KEYFP|MCDB_FLAG_MPH|MCDB_FLAG_SWISS)
+#define MCDB_DPOS48_MASK ((UINT64_C(1) << 48) - 1)
+#define mcdb_keyfp(h) ((h) >> 16)  /* key fingerprint from 32-bit hash */
+
+/* MCDB_FLAG_SLOTS: lvl1 fan-out of 2^slot_bits slots (slot_bits 9 - 16)
+ * instead of the 256 slots in the header.  Slot table (16 bytes per slot,
+ * same as header slots) follows the lvl2 hash tables, at end of mcdb, and each
+ * header slot contains hpos of the slot table and hslots 0.  Slot is selected
+ * by low slot_bits of khash and lvl2 entry by khash >> slot_bits.
+ * (open hash table layout only; not MCDB_FLAG_MPH or MCDB_FLAG_SWISS) */
+#define MCDB_SLOT_BITS_MAX 16
+
+/* MCDB_FLAG_MPH: lvl2 index for each lvl1 slot is a hash-and-displace perfect
+ * hash (CHD-like) of the keys in the slot.  At hpos: 4-byte seed, 4-byte nb
+ * (num buckets), nb 2-byte displacements (padded to multiple of 8 bytes), and
+ * hslots dpos entries (4-byte if b==3, 8-byte if b==4; 0 if entry unused).
+ * Bucket is selected by khash; entry by second key hash (uint32_hash_mix()
+ * seeded w/ khash) and bucket displacement.  (requires uint32.h)
+ * (approx 4.6 bytes per key if b==3, instead of 16 bytes of open hash table) */
+#define MCDB_MPH_LAMBDA 4u        /* avg keys per bucket */
+#define MCDB_MPH_DISP_MAX 65536u  /* num displacements tried per bucket */
+#define mcdb_mph_nb(n)     ((n) / MCDB_MPH_LAMBDA + 1)
+#define mcdb_mph_hslots(n) ((n) + ((n) >> 6) + 1)   /* ~1.5% unused entries */
+#define mcdb_mph_hdrsz(nb) (8 + ((((uintptr_t)(nb)) * 2 + 7) & ~(uintptr_t)7))
+#define mcdb_mph_tblsz(nb,hslots,b) \
+  (mcdb_mph_hdrsz(nb) + ((uintptr_t)(hslots) << ((b)-1)))
+/* MCDB_FLAG_SWISS: lvl2 hash table for each lvl1 slot is hslots groups of
+ * 64 bytes (one cache line; table is 64-byte aligned).  Each group contains
+ * 1-byte control entries followed by dpos entries:
+ *   b==3: 12 control bytes, 4 bytes padding, 12 4-byte dpos
+ *   b==4:  7 control bytes, 1 byte  padding,  7 8-byte dpos
+ * Control byte is 0 if entry is empty, else 0x80 | 7-bit tag from khash.
+ * Probe begins at group (khash >> 8) % hslots, comparing control bytes of
+ * group against tag all at once, and continues to next group only if group
+ * contains no empty entry.  Groups are filled to approx 7/8 of entries. */
+#define MCDB_SWISS_SHIFT 6  /* 64-byte groups */
+#define mcdb_swiss_entries(b) ((b) == 3 ? 12u : 7u)
+#define mcdb_swiss_dpos(b)    ((b) == 3 ? 16u : 8u) /* offset of dpos in group*/
+#define mcdb_swiss_tag(khash) (0x80u | ((khash) >> 25))
+#define mcdb_swiss_groups(n,b) \
+  (((n) + (n) / 7 + mcdb_swiss_entries(b) - 1) / mcdb_swiss_entries(b))
+
+#define mcdb_reduce32(h,n) ((uint32_t)(((uint64_t)(h) * (n)) >> 32))
+#define mcdb_mph_bucket(khash,seed,nb) \
+  mcdb_reduce32(uint32_mix32(((khash) >> MCDB_SLOT_BITS) + (seed)), (nb))
+#define mcdb_mph_pos(y,seed,d,hslots) \
+  mcdb_reduce32(uint32_mix32((y) ^ (seed) ^ ((uint32_t)(d) * 0x9E3779B9u)), \
+                (hslots))
+
+/* built-in hash functions (hash func id is stored in mcdb header) */
+enum mcdb_hash_id {
+  MCDB_HASH_DJB    = 0,       /* djb cdb hash (default) */
+  MCDB_HASH_CRC32C = 1,       /* CRC32C (hardware accelerated if available) */
+  MCDB_HASH_MIX    = 2        /* multiply-mix hash; fast for long keys */
+};
+
+/* hash func for hash func id (NULL if hash func id not known) */
+extern uint32_t (*mcdb_hash_fn(uint32_t))(uint32_t,const void * restrict,size_t)
+  __attribute_warn_unused_result__  __attribute_nothrow__;
+
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
@@ -268,6 +518,8 @@ HIDDEN extern __typeof (mcdb_mmap_refresh_check)
                         mcdb_mmap_refresh_check_h;
 HIDDEN extern __typeof (mcdb_mmap_thread_registration)
                         mcdb_mmap_thread_registration_h;
+HIDDEN extern __typeof (mcdb_mmap_thread_register_shared)
+                        mcdb_mmap_thread_register_shared_h;
 HIDDEN extern __typeof (mcdb_mmap_reopen_threadsafe)
                         mcdb_mmap_reopen_threadsafe_h;
 #else
@@ -279,6 +531,7 @@ HIDDEN extern __typeof (mcdb_mmap_reopen_threadsafe)
 #define mcdb_mmap_destroy_h              mcdb_mmap_destroy
 #define mcdb_mmap_refresh_check_h        mcdb_mmap_refresh_check
 #define mcdb_mmap_thread_registration_h  mcdb_mmap_thread_registration 
+#define mcdb_mmap_thread_register_shared_h mcdb_mmap_thread_register_shared
 #define mcdb_mmap_reopen_threadsafe_h    mcdb_mmap_reopen_threadsafe
 #endif
 
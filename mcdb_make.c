@@ -104,13 +104,18 @@ mcdb_make_err(struct mcdb_make * const restrict m, int errnum)
     return -1;
 }
 
+/* index of hplist for khash: high MCDB_SLOT_BITS of lvl1 slot bits
+ * (khash & MCDB_SLOT_MASK unless MCDB_FLAG_SLOTS; see mcdb_make_slots_ext()) */
+#define mcdb_make_slot_idx(m,h) \
+  (((h) >> ((m)->slot_bits - MCDB_SLOT_BITS)) & MCDB_SLOT_MASK)
+
 static bool  __attribute_noinline__
 mcdb_hplist_alloc(struct mcdb_make * const restrict m)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 static bool
 mcdb_hplist_alloc(struct mcdb_make * const restrict m)
 {
-    uint32_t i = m->hp.h & MCDB_SLOT_MASK;
+    uint32_t i = mcdb_make_slot_idx(m, m->hp.h);
     struct mcdb_hplist * const head = m->head[i];
     struct mcdb_hplist * const pend = head->pend;
     if (pend != NULL) {
@@ -374,24 +379,46 @@ mcdb_make_addbuf_key(struct mcdb_make * const restrict m,
 {
     /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
      * unless the len is shorter from partial contents of buf. */
-    m->hp.h = (m->hash_fn == uint32_hash_djb)
-      ? uint32_hash_djb(m->hp.h, buf, len)
-      : m->hash_fn(m->hp.h, buf, len);
+    if (m->hash_fn == uint32_hash_djb)
+        m->hp.h = uint32_hash_djb(m->hp.h, buf, len);
+    else if (m->hash_fn != uint32_hash_mix) /*(mix hashed in addend)*/
+        m->hp.h = m->hash_fn(m->hp.h, buf, len);
     mcdb_make_addbuf_data(m, buf, len);
 }
 
-void  inline
-mcdb_make_addend(struct mcdb_make * const restrict m)
+/* copy hp data structure into list for hp slot mask (m->hp.h is key hash) */
+static inline void
+mcdb_make_addend_hp(struct mcdb_make * const restrict m)
 {
-    /* copy hp data structure into list for hp slot mask */
-    const uint32_t slot_idx = m->hp.h & MCDB_SLOT_MASK;
-    const uint32_t i = m->head[slot_idx]->num++;
+    uint32_t slot_idx;
+    uint32_t i;
+    slot_idx = mcdb_make_slot_idx(m, m->hp.h);
+    i = m->head[slot_idx]->num++;
     m->head[slot_idx]->hp[i] = m->hp;
+    if (m->flags & (MCDB_FLAG_KEYFP|MCDB_FLAG_MPH)) {/*(second key hash)*/
+        const uint32_t y =
+          uint32_hash_mix(m->hp.h, m->map+m->hp.p+8-m->offset, m->hp.l);
+        if (m->flags & MCDB_FLAG_MPH)   /*(klen not used by MPH index)*/
+            m->head[slot_idx]->hp[i].l = y;
+      #if defined(_LP64) || defined(__LP64__)
+        else  /*(MCDB_FLAG_KEYFP: key fingerprint in high bits of dpos)*/
+            m->head[slot_idx]->hp[i].p |= (uintptr_t)mcdb_keyfp(y) << 48;
+      #endif
+    }
     ++m->count[slot_idx];
     if (i == MCDB_HPLIST-1)
         m->hp.l = ~0; /* set flag for mcdb_make_start() to allocate lists */
 }
 
+void  inline
+mcdb_make_addend(struct mcdb_make * const restrict m)
+{
+    if (m->hash_fn == uint32_hash_mix) /*(not streamable; key is in mmap)*/
+        m->hp.h = uint32_hash_mix(m->hash_init,
+                                  m->map + m->hp.p + 8 - m->offset, m->hp.l);
+    mcdb_make_addend_hp(m);
+}
+
 void  inline
 mcdb_make_addrevert(struct mcdb_make * const restrict m)
 {   /* e.g. discard in-progress incremental addbuf, or immediately prior add */
@@ -412,6 +439,191 @@ mcdb_make_add(struct mcdb_make * const restrict m,
     return -1;
 }
 
+/* add record w/ key hash precomputed by caller, e.g. in another thread
+ * (khash must be m->hash_fn(m->hash_init, key, keylen)) */
+int
+mcdb_make_add_hashed(struct mcdb_make * const restrict m,
+                     const char * const restrict key, const size_t keylen,
+                     const char * const restrict data, const size_t datalen,
+                     const uint32_t khash)
+{
+    if (mcdb_make_addbegin(m, keylen, datalen) == 0) {
+        mcdb_make_addbuf_data(m, key, keylen);
+        mcdb_make_addbuf_data(m, data, datalen);
+        m->hp.h = khash;
+        mcdb_make_addend_hp(m);
+        return 0;
+    }
+    return -1;
+}
+
+/* mcdb_make_shard: records of one producer (thread), merged into mcdb in
+ * mcdb_make_finish().  Records are appended in mcdb record format (klen, dlen,
+ * key, data) to blocks allocated by the shard, and hp entries are kept in an
+ * array owned by the shard, with hp.p the offset of the record in the shard.
+ * mcdb_make_shard_add() modifies only its shard and needs no lock. */
+
+#define MCDB_MAKE_SHARD_BLKSZ (1024*1024)
+
+struct mcdb_make_shard_blk {
+  struct mcdb_make_shard_blk *next;
+  size_t pos;
+  size_t sz;
+  char data[];
+};
+
+struct mcdb_make_shard {
+  struct mcdb_make_shard *next;      /* shards merged in order created */
+  struct mcdb_make_shard_blk *head;
+  struct mcdb_make_shard_blk *tail;  /* block to which records are appended */
+  struct mcdb_hp *hp;
+  size_t num;                        /* num hp entries (records) */
+  size_t hpsz;                       /* num hp entries allocated */
+  size_t pos;                        /* total len of records in shard */
+  uint32_t hash_init;
+  uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t);
+  void * (*fn_malloc)(size_t);
+  void (*fn_free)(void *);
+};
+
+struct mcdb_make_shard *
+mcdb_make_shard_create(struct mcdb_make * const restrict m)
+{
+    struct mcdb_make_shard **next;
+    struct mcdb_make_shard * const restrict s = (struct mcdb_make_shard *)
+      m->fn_malloc(sizeof(struct mcdb_make_shard));
+    if (s == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    s->next      = NULL;
+    s->head      = NULL;
+    s->tail      = NULL;
+    s->hp        = NULL;
+    s->num       = 0;
+    s->hpsz      = 0;
+    s->pos       = 0;
+    s->hash_init = m->hash_init;
+    s->hash_fn   = m->hash_fn;
+    s->fn_malloc = m->fn_malloc;
+    s->fn_free   = m->fn_free;
+    for (next = &m->shards; *next != NULL; next = &(*next)->next)
+        ;
+    *next = s;
+    return s;
+}
+
+int
+mcdb_make_shard_add(struct mcdb_make_shard * const restrict s,
+                    const char * const restrict key, const size_t keylen,
+                    const char * const restrict data, const size_t datalen)
+{
+    struct mcdb_make_shard_blk *blk = s->tail;
+    struct mcdb_hp *hp;
+    char *p;
+    const size_t len = 8 + keylen + datalen;/* arbitrary ~2 GB limit for lens */
+    if (keylen>INT_MAX-8 || datalen>INT_MAX-8)return mcdb_make_err(NULL,EINVAL);
+  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+    if (s->pos > UINT_MAX-len)                return mcdb_make_err(NULL,ENOMEM);
+  #endif
+    if (blk == NULL || blk->sz - blk->pos < len) {
+        const size_t sz = (len > MCDB_MAKE_SHARD_BLKSZ)
+          ? len
+          : MCDB_MAKE_SHARD_BLKSZ;
+        blk = (struct mcdb_make_shard_blk *)
+          s->fn_malloc(sizeof(struct mcdb_make_shard_blk) + sz);
+        if (blk == NULL)                      return mcdb_make_err(NULL,ENOMEM);
+        blk->next = NULL;
+        blk->pos  = 0;
+        blk->sz   = sz;
+        if (s->tail != NULL)
+            s->tail->next = blk;
+        else
+            s->head = blk;
+        s->tail = blk;
+    }
+    if (s->num == s->hpsz) {  /* (fn_malloc and fn_free; no fn_realloc) */
+        const size_t hpsz = (s->hpsz != 0) ? s->hpsz << 1 : 1024;
+        hp = (struct mcdb_hp *)s->fn_malloc(hpsz * sizeof(struct mcdb_hp));
+        if (hp == NULL)                       return mcdb_make_err(NULL,ENOMEM);
+        if (s->hp != NULL) {
+            memcpy(hp, s->hp, s->num * sizeof(struct mcdb_hp));
+            s->fn_free(s->hp);
+        }
+        s->hp   = hp;
+        s->hpsz = hpsz;
+    }
+    p = blk->data + blk->pos;
+    uint32_strpack_bigendian_macro(p,keylen);
+    uint32_strpack_bigendian_macro(p+4,datalen);
+    memcpy(p+8, key, keylen);
+    memcpy(p+8+keylen, data, datalen);
+    hp = s->hp + s->num++;
+    hp->p = s->pos;
+    hp->h = s->hash_fn(s->hash_init, key, keylen);
+    hp->l = (uint32_t)keylen;
+    blk->pos += len;
+    s->pos   += len;
+    return 0;
+}
+
+static void
+mcdb_make_shards_free(struct mcdb_make * const restrict m)
+  __attribute_nonnull__;
+static void
+mcdb_make_shards_free(struct mcdb_make * const restrict m)
+{
+    struct mcdb_make_shard *s;
+    struct mcdb_make_shard_blk *blk;
+    while ((s = m->shards) != NULL) {
+        m->shards = s->next;
+        while ((blk = s->head) != NULL) {
+            s->head = blk->next;
+            s->fn_free(blk);
+        }
+        if (s->hp != NULL)
+            s->fn_free(s->hp);
+        s->fn_free(s);
+    }
+}
+
+/* append records of each shard (in order shards were created) after records
+ * added directly to m, and add hp entries to slot lists */
+static bool  __attribute_noinline__
+mcdb_make_shards_merge(struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_make_shards_merge(struct mcdb_make * const restrict m)
+{
+    const struct mcdb_make_shard *s;
+    const struct mcdb_make_shard_blk *blk;
+    size_t base;
+    size_t i;
+    for (s = m->shards; s != NULL; s = s->next) {
+      #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+        if (m->pos > UINT_MAX-s->pos) { errno = ENOMEM; return false; }
+      #endif
+        base = m->pos;
+        if (m->offset+m->msz < base+s->pos
+            && !mcdb_mmap_upsize(m, base+s->pos, true))
+            return false;
+        for (blk = s->head; blk != NULL; blk = blk->next) {
+            memcpy(m->map + m->pos - m->offset, blk->data, blk->pos);
+            m->pos += blk->pos;
+        }
+        for (i = 0; i < s->num; ++i) {
+            if (m->hp.l == ~0 && !mcdb_hplist_alloc(m))
+                return false;
+            m->hp.p = base + s->hp[i].p;
+            m->hp.h = s->hp[i].h;
+            m->hp.l = s->hp[i].l;
+            mcdb_make_addend_hp(m);
+        }
+    }
+    mcdb_make_shards_free(m);
+    return true;
+}
+
 /* Note: it is recommended that fd be the fd returned from a call to mkstemp()
  * and that the temporary file be renamed (by the caller) upon success */
 int
@@ -422,7 +634,15 @@ mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
     m->pos       = MCDB_HEADER_SZ;
     m->offset    = 0;
     m->hash_init = UINT32_HASH_DJB_INIT;
+    m->hash_id   = MCDB_HASH_DJB;
     m->hash_fn   = uint32_hash_djb;
+    m->flags     = MCDB_FLAGS_NONE;
+    m->hslots_pct= MCDB_MAKE_HSLOTS_PCT;
+    m->insert    = MCDB_MAKE_INSERT_LINEAR;
+    m->slot_bits = MCDB_SLOT_BITS;
+    m->gen       = 0;
+    m->threads   = 1;
+    m->shards    = NULL;
     m->fsz       = 0;
     m->osz       = 0;
     m->msz       = 0;
@@ -454,6 +674,646 @@ mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
     }
 }
 
+int
+mcdb_make_setopts(struct mcdb_make * const restrict m,
+                  const struct mcdb_make_opts * const restrict opts)
+{
+    uint32_t (* const hash_fn)(uint32_t, const void * restrict, size_t) =
+      mcdb_hash_fn(opts->hash_id);
+    if (hash_fn == NULL)                       return mcdb_make_err(NULL,EINVAL);
+    if (opts->flags & ~MCDB_FLAGS_KNOWN)       return mcdb_make_err(NULL,EINVAL);
+    if ((opts->flags & MCDB_FLAGS_LAYOUT)  /*(at most one lvl2 table layout)*/
+        & ((opts->flags & MCDB_FLAGS_LAYOUT) - 1))
+                                               return mcdb_make_err(NULL,EINVAL);
+    if (opts->hslots_pct != 0
+        && (opts->hslots_pct < MCDB_MAKE_HSLOTS_PCT_MIN
+            || opts->hslots_pct > MCDB_MAKE_HSLOTS_PCT_MAX
+            || (opts->flags & (MCDB_FLAG_MPH|MCDB_FLAG_SWISS))))
+                                               return mcdb_make_err(NULL,EINVAL);
+    if (opts->insert > MCDB_MAKE_INSERT_ROBINHOOD
+        || (opts->insert != MCDB_MAKE_INSERT_LINEAR
+            && (opts->flags & (MCDB_FLAG_MPH|MCDB_FLAG_SWISS))))
+                                               return mcdb_make_err(NULL,EINVAL);
+    if (opts->slot_bits != 0
+        && (opts->slot_bits < MCDB_SLOT_BITS
+            || opts->slot_bits > MCDB_SLOT_BITS_MAX
+            || (opts->slot_bits > MCDB_SLOT_BITS
+                && (opts->flags & (MCDB_FLAG_MPH|MCDB_FLAG_SWISS)))))
+                                               return mcdb_make_err(NULL,EINVAL);
+  #if !defined(_LP64) && !defined(__LP64__) /*(keyfp stored in mcdb_hp.p)*/
+    if (opts->flags & MCDB_FLAG_KEYFP)         return mcdb_make_err(NULL,ENOTSUP);
+  #endif
+    if (m->pos != MCDB_HEADER_SZ || m->shards != NULL)
+                                               return mcdb_make_err(NULL,EPERM);
+    m->slot_bits = (opts->slot_bits != 0) ? opts->slot_bits : MCDB_SLOT_BITS;
+    m->flags     = (m->slot_bits > MCDB_SLOT_BITS) /*(flag set by slot_bits)*/
+      ? opts->flags |  MCDB_FLAG_SLOTS
+      : opts->flags & ~MCDB_FLAG_SLOTS;
+    m->hslots_pct= (opts->hslots_pct != 0)
+      ? opts->hslots_pct
+      : MCDB_MAKE_HSLOTS_PCT;
+    m->insert    = opts->insert;
+    m->gen       = opts->gen;
+    m->threads   = (opts->threads != 0) ? opts->threads : 1;
+    m->hash_id   = opts->hash_id;
+    m->hash_fn   = hash_fn;
+    m->hash_init = (opts->hash_id != MCDB_HASH_DJB)
+      ? opts->hash_seed
+      : UINT32_HASH_DJB_INIT;
+    return 0;
+}
+
+/* num lvl2 hash table entries for n records (open hash table layout)
+ * (always > n for n != 0 since pct >= MCDB_MAKE_HSLOTS_PCT_MIN; table has
+ *  at least one empty entry to terminate probe of keys not in mcdb) */
+static inline uint32_t
+mcdb_make_hslots(const uint32_t n, const uint32_t pct)
+{
+    return (pct == MCDB_MAKE_HSLOTS_PCT)
+      ? n << 1
+      : n + (uint32_t)(((uint64_t)n * (pct - 100) + 99) / 100);
+}
+
+/* store open hash table entry (b==3: khash, 32-bit dpos;
+ *                              b==4: khash, klen, 64-bit dpos) */
+static inline void
+mcdb_make_entry(char * const restrict q, const uint32_t b,
+                const uint32_t h, const uint32_t l, const uint64_t d)
+{
+    uint32_strpack_bigendian_aligned_macro(q, h);                  /*khash*/
+    if (b == 3)
+        uint32_strpack_bigendian_aligned_macro(q+4, (uint32_t)d);  /*dpos*/
+    else {
+        uint32_strpack_bigendian_aligned_macro(q+4, l);            /*klen*/
+        uint64_strpack_bigendian_aligned_macro(q+8, d);            /*dpos*/
+    }
+}
+
+/* MCDB_MAKE_INSERT_ROBINHOOD: insert entry into open hash table (b==3 or b==4)
+ * Entry being placed displaces occupied entry which is nearer to its home
+ * entry, and displaced entry continues probing.  Entries with same home entry
+ * (equal distance at same entry) are ordered by dpos so that duplicate keys
+ * remain in insertion order.  (dmask masks key fingerprint from dpos)
+ * (sbits is num lvl1 slot bits; home entry is (khash >> sbits) % len) */
+static void
+mcdb_make_robinhood(char * const restrict p, const uint32_t len,
+                    const uint32_t b, const uint32_t sbits,
+                    const uint64_t dmask, const struct mcdb_hp * const hp)
+  __attribute_nonnull__;
+
+static void
+mcdb_make_robinhood(char * const restrict p, const uint32_t len,
+                    const uint32_t b, const uint32_t sbits,
+                    const uint64_t dmask, const struct mcdb_hp * const hp)
+{
+    uint32_t h = hp->h, l = hp->l, eh, el, u, dist, edist;
+    uint64_t d = (uint64_t)hp->p, ed;
+    char * restrict q;
+    for (u = (h >> sbits) % len, dist = 0; ; ++dist) {
+        q  = p + ((uintptr_t)u << b);
+        ed = (b == 3)
+          ? uint32_strunpack_bigendian_aligned_macro(q+4)
+          : uint64_strunpack_bigendian_aligned_macro(q+8);
+        if (ed == 0)   /* empty entry (dpos == 0) */
+            break;
+        eh = uint32_strunpack_bigendian_aligned_macro(q);
+        edist = u - (eh >> sbits) % len;
+        if (edist > u) /*(wrapped)*/
+            edist += len;
+        if (dist > edist || (dist == edist && (d&dmask) < (ed&dmask))) {
+            el = (b == 3) ? 0 : uint32_strunpack_bigendian_aligned_macro(q+4);
+            mcdb_make_entry(q, b, h, l, d);
+            h = eh; l = el; d = ed; dist = edist;
+        }
+        if (++u == len)
+            u = 0;
+    }
+    mcdb_make_entry(q, b, h, l, d);
+}
+
+/* MCDB_MAKE_INSERT_LINEAR: insert entry into open hash table at first empty
+ * entry from home entry (same as insertion loops in mcdb_make_finish()) */
+static void
+mcdb_make_linear(char * const restrict p, const uint32_t len,
+                 const uint32_t b, const uint32_t sbits,
+                 const struct mcdb_hp * const hp)
+  __attribute_nonnull__;
+
+static void
+mcdb_make_linear(char * const restrict p, const uint32_t len,
+                 const uint32_t b, const uint32_t sbits,
+                 const struct mcdb_hp * const hp)
+{
+    uint32_t u = (hp->h >> sbits) % len;
+    char * restrict q = p + ((uintptr_t)u << b);
+    /* find empty entry in open hash table (dpos == 0) */
+    while (b == 3 ? *(uint32_t *)(q+4) != 0 : *(uint64_t *)(q+8) != 0) {
+        if (++u == len)
+            u = 0;
+        q = p + ((uintptr_t)u << b);
+    }
+    mcdb_make_entry(q, b, hp->h, hp->l, (uint64_t)hp->p);
+}
+
+/* MCDB_FLAG_SLOTS: build lvl2 hash tables for 2^slot_bits lvl1 slots, and
+ * append lvl1 slot table following hash tables (see mcdb.h).  Each of the
+ * MCDB_SLOTS lists holds keys of the high MCDB_SLOT_BITS of lvl1 slot bits
+ * (mcdb_make_slot_idx()), and keys of each list are partitioned by the low
+ * (slot_bits - MCDB_SLOT_BITS) bits of khash (stable; preserves order of
+ * duplicate keys), so that hash tables are written in lvl1 slot order */
+static bool  __attribute_noinline__
+mcdb_make_slots_ext(struct mcdb_make * const restrict m,
+                    char * const restrict header, const uint32_t b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool  __attribute_noinline__
+mcdb_make_slots_ext(struct mcdb_make * const restrict m,
+                    char * const restrict header, const uint32_t b)
+{
+    const uint32_t * const restrict count = m->count;
+    const uint32_t sbits = m->slot_bits;
+    const uint32_t nsub  = 1u << (sbits - MCDB_SLOT_BITS);
+    const uint64_t dmask = (m->flags & MCDB_FLAG_KEYFP)
+      ? MCDB_DPOS48_MASK
+      : ~(uint64_t)0;
+    uint32_t send[1u << (MCDB_SLOT_BITS_MAX - MCDB_SLOT_BITS)];
+    uint32_t cnt = 0;
+    uint32_t len;
+    uint32_t start;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+    uintptr_t d;
+    uintptr_t sz;
+    char *p;
+    char *slots;
+    struct mcdb_hp *keys;
+    bool rc = true;
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        if (cnt < count[i])
+            cnt = count[i];
+    }
+    /* scratch: keys of a slot (partitioned), lvl1 slot table */
+    keys = (struct mcdb_hp *)
+      m->fn_malloc(cnt * sizeof(struct mcdb_hp) + ((size_t)16 << sbits));
+    if (keys == NULL) return false;
+    slots = (char *)(keys + cnt);
+
+    for (i = 0; i < MCDB_SLOTS && rc; ++i) {
+        /* counting sort keys by sub-slot (low bits of khash) */
+        memset(send, 0, nsub * sizeof(uint32_t));
+        for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
+            for (j = 0; j < x->num; ++j)
+                ++send[x->hp[j].h & (nsub-1)];
+        }
+        for (n = 0, j = 0; j < nsub; ++j) {
+            len = send[j];
+            send[j] = n;
+            n += len;
+        }
+        for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
+            for (j = 0; j < x->num; ++j)
+                keys[send[x->hp[j].h & (nsub-1)]++] = x->hp[j];
+        }
+        /*(send[j] is now end of keys in sub-slot j)*/
+
+        for (j = 0, start = 0; j < nsub; start = send[j++]) {
+            const struct mcdb_hp * const restrict hp = keys + start;
+            n   = send[j] - start;   /* num keys in sub-slot */
+            len = mcdb_make_hslots(n, m->hslots_pct);
+            sz  = (uintptr_t)len << b;
+            d   = m->pos;
+
+            /* mmap sufficient space into which to write hash table */
+            if (m->offset+m->msz < d+sz && !mcdb_mmap_upsize(m, d+sz, false)) {
+                rc = false;
+                break;
+            }
+
+            /* lvl1 slot (khash & ((1 << slot_bits)-1)) is (i << sb) | j */
+            p = slots + ((((uintptr_t)i << (sbits - MCDB_SLOT_BITS)) | j) << 4);
+            uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
+            uint32_strpack_bigendian_aligned_macro(p+8,len);       /* hslots */
+            *(uint32_t *)(p+12) = 0;
+
+            p = m->map + m->pos - m->offset;
+            m->pos += sz;
+            memset(p, 0, sz);
+            if (m->insert == MCDB_MAKE_INSERT_ROBINHOOD) {
+                for (uint32_t w = 0; w < n; ++w)
+                    mcdb_make_robinhood(p, len, b, sbits, dmask, hp+w);
+            }
+            else {
+                for (uint32_t w = 0; w < n; ++w)
+                    mcdb_make_linear(p, len, b, sbits, hp+w);
+            }
+        }
+    }
+
+    if (rc) {
+        /* append lvl1 slot table; each header slot: hpos of slot table,
+         * hslots 0 (readers unaware of MCDB_FLAG_SLOTS see no records) */
+        d  = m->pos;
+        sz = (uintptr_t)16 << sbits;
+        if (m->offset+m->msz < d+sz && !mcdb_mmap_upsize(m, d+sz, false))
+            rc = false;
+        else {
+            memcpy(m->map + m->pos - m->offset, slots, sz);
+            m->pos += sz;
+            for (i = 0; i < MCDB_SLOTS; ++i) {
+                p = header + (i << 4);
+                uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d);
+                uint32_strpack_bigendian_aligned_macro(p+8,0);
+                *(uint32_t *)(p+12) = 0;
+            }
+        }
+    }
+
+    m->fn_free(keys);
+    return rc;
+}
+
+/* MCDB_FLAG_MPH: build perfect hash index for keys in slot (see mcdb.h)
+ * Keys are grouped into buckets by khash, and buckets are placed largest first,
+ * each trying displacements until all keys in bucket land in unused entries.
+ * (hp.l holds second key hash (set in mcdb_make_addend()) instead of klen)
+ * Identical keys can not be placed and are rejected (EINVAL) */
+#define MCDB_MPH_SEEDS 16u
+
+static bool  __attribute_noinline__
+mcdb_make_mph(const struct mcdb_hplist * restrict x, const uint32_t n,
+              char * const restrict p, const uint32_t hslots, const uint32_t b,
+              struct mcdb_hp * const restrict keys,
+              uint32_t * const restrict bstart, uint32_t * const restrict border,
+              uint32_t * const restrict order, uint32_t * const restrict pos)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool  __attribute_noinline__
+mcdb_make_mph(const struct mcdb_hplist * restrict x, const uint32_t n,
+              char * const restrict p, const uint32_t hslots, const uint32_t b,
+              struct mcdb_hp * const restrict keys,
+              uint32_t * const restrict bstart, uint32_t * const restrict border,
+              uint32_t * const restrict order, uint32_t * const restrict pos)
+{
+    const uint32_t nb = mcdb_mph_nb(n);
+    char * const restrict e = p + mcdb_mph_hdrsz(nb);  /* dpos entries */
+    uint32_t scnt[257];
+    uint32_t seed, k, j, u, s, d, bk;
+
+    for (k = 0; x; x = x->next) {
+        memcpy(keys+k, x->hp, x->num * sizeof(struct mcdb_hp));
+        k += x->num;
+    }
+
+    for (seed = 0; seed < MCDB_MPH_SEEDS; ++seed) {
+
+        /* group keys by bucket (counting sort) */
+        memset(bstart, 0, (nb + 1) * sizeof(uint32_t));
+        for (k = 0; k < n; ++k)
+            ++bstart[mcdb_mph_bucket(keys[k].h, seed, nb) + 1];
+        for (bk = 0; bk < nb; ++bk)
+            border[bk] = (bstart[bk+1] += bstart[bk]);
+        for (k = n; k--; ) /*(border used as cursor; fill buckets from end)*/
+            order[--border[mcdb_mph_bucket(keys[k].h, seed, nb)]] = k;
+
+        /* order buckets by size, largest first (counting sort) */
+        memset(scnt, 0, sizeof(scnt));
+        for (bk = 0; bk < nb; ++bk) {
+            s = bstart[bk+1] - bstart[bk];
+            ++scnt[256 - (s < 256 ? s : 255)];
+        }
+        for (u = 0, s = 0; s < 257; ++s) {
+            const uint32_t c = scnt[s];
+            scnt[s] = u;
+            u += c;
+        }
+        for (bk = 0; bk < nb; ++bk) {
+            s = bstart[bk+1] - bstart[bk];
+            border[scnt[256 - (s < 256 ? s : 255)]++] = bk;
+        }
+
+        memset(p, 0, (size_t)mcdb_mph_tblsz(nb, hslots, b));
+        for (bk = 0; bk < nb; ++bk) {
+            const uint32_t * const restrict bkeys = order + bstart[border[bk]];
+            s = bstart[border[bk]+1] - bstart[border[bk]];
+            if (s == 0)
+                break;  /* (remaining buckets are empty) */
+
+            /* keys w/ same second hash in bucket collide for every d */
+            for (k = 1; k < s; ++k) {
+                for (j = 0; j < k; ++j) {
+                    if (keys[bkeys[k]].l == keys[bkeys[j]].l) {
+                        if (keys[bkeys[k]].h == keys[bkeys[j]].h)
+                            return (errno = EINVAL, false);/*dup key(likely)*/
+                        break;
+                    }
+                }
+                if (j < k) break;
+            }
+            if (k < s) break;   /* try next seed */
+
+            for (d = 0; d < MCDB_MPH_DISP_MAX; ++d) {
+                for (k = 0; k < s; ++k) {
+                    pos[k] = mcdb_mph_pos(keys[bkeys[k]].l, seed, d, hslots);
+                    if ((b == 3)
+                        ? *(uint32_t *)(e + ((uintptr_t)pos[k] << 2)) != 0
+                        : *(uint64_t *)(e + ((uintptr_t)pos[k] << 3)) != 0)
+                        break;
+                    for (j = 0; j < k && pos[j] != pos[k]; ++j) ;
+                    if (j < k)
+                        break;
+                }
+                if (k == s)
+                    break;
+            }
+            if (d == MCDB_MPH_DISP_MAX)
+                break;  /* try next seed */
+
+            /* place bucket */
+            for (k = 0; k < s; ++k) {
+                if (b == 3)
+                    uint32_strpack_bigendian_aligned_macro(
+                      e + ((uintptr_t)pos[k] << 2), (uint32_t)keys[bkeys[k]].p);
+                else {
+                    uint64_strpack_bigendian_aligned_macro(
+                      e + ((uintptr_t)pos[k] << 3), (uint64_t)keys[bkeys[k]].p);
+                }
+            }
+            p[8 + (border[bk] << 1)]     = (char)(d >> 8);
+            p[8 + (border[bk] << 1) + 1] = (char)(d & 0xFF);
+        }
+        if (bk == nb || s == 0) {
+            uint32_strpack_bigendian_aligned_macro(p, seed);
+            uint32_strpack_bigendian_aligned_macro(p+4, nb);
+            return true;
+        }
+    }
+
+    return (errno = EINVAL, false);
+}
+
+/* MCDB_FLAG_SWISS: fill hash table of 64-byte groups for slot (see mcdb.h)
+ * (groups * entries per group >= num keys, so an empty entry is always found)*/
+static void
+mcdb_make_swiss(const struct mcdb_hplist * restrict x, const uint32_t groups,
+                char * const restrict p, const uint32_t b)
+  __attribute_nonnull__;
+
+static void
+mcdb_make_swiss(const struct mcdb_hplist * restrict x, const uint32_t groups,
+                char * const restrict p, const uint32_t b)
+{
+    const uint32_t ne = mcdb_swiss_entries(b);
+    for (; x; x = x->next) {
+        const struct mcdb_hp * restrict hp = x->hp;
+        char * restrict q;
+        uint32_t e;
+        for (uint32_t w = x->num; w; --w, ++hp) {
+            uint32_t g = (hp->h >> MCDB_SLOT_BITS) % groups;
+            /* find first group w/ empty entry (control byte == 0) */
+            for (;;) {
+                q = p + ((uintptr_t)g << MCDB_SWISS_SHIFT);
+                for (e = 0; e < ne && q[e] != 0; ++e) ;
+                if (e < ne)
+                    break;
+                if (++g == groups)
+                    g = 0;
+            }
+            q[e] = (char)mcdb_swiss_tag(hp->h);
+            q += mcdb_swiss_dpos(b);
+            if (b == 3) {
+                uint32_strpack_bigendian_aligned_macro(q+(e<<2),(uint32_t)hp->p);
+            }
+            else {
+                uint64_strpack_bigendian_aligned_macro(q+(e<<3),(uint64_t)hp->p);
+            }
+        }
+    }
+}
+
+static bool  __attribute_noinline__
+mcdb_make_mph_slots(struct mcdb_make * const restrict m,
+                    char * const restrict header, const uint32_t b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool  __attribute_noinline__
+mcdb_make_mph_slots(struct mcdb_make * const restrict m,
+                    char * const restrict header, const uint32_t b)
+{
+    const uint32_t * const restrict count = m->count;
+    uint32_t cnt = 0;
+    uint32_t nbmax;
+    uint32_t nb;
+    uint32_t hslots;
+    uint32_t i;
+    uintptr_t d;
+    uintptr_t sz;
+    char *p;
+    struct mcdb_hp *keys;
+    bool rc = true;
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        if (cnt < count[i])
+            cnt = count[i];
+    }
+    nbmax = mcdb_mph_nb(cnt);
+    /* scratch: keys, bucket start, bucket order, key order, key positions */
+    keys = (struct mcdb_hp *)
+      m->fn_malloc(cnt * sizeof(struct mcdb_hp)
+                   + ((size_t)nbmax*2 + 1 + (size_t)cnt*2) * sizeof(uint32_t));
+    if (keys == NULL) return false;
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        hslots = count[i] ? mcdb_mph_hslots(count[i]) : 0;
+        nb     = mcdb_mph_nb(count[i]);
+        sz     = count[i] ? mcdb_mph_tblsz(nb, hslots, b) : 0;
+        d      = m->pos;
+
+        /* mmap sufficient space into which to write index for this slot */
+        if (m->offset+m->msz < d+sz && !mcdb_mmap_upsize(m, d+sz, false)) {
+            rc = false;
+            break;
+        }
+
+        /* constant header (16 bytes per header slot, so multiply by 16) */
+        p = header + (i << 4);  /* (i << 4) == (i * 16) */
+        uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
+        uint32_strpack_bigendian_aligned_macro(p+8,hslots);    /* hslots */
+        *(uint32_t *)(p+12) = 0;     /*(fill hole with 0 only for consistency)*/
+
+        p = m->map + m->pos - m->offset;
+        m->pos += sz;
+        if (count[i] != 0
+            && !mcdb_make_mph(m->head[i], count[i], p, hslots, b, keys,
+                              (uint32_t *)(keys + cnt),
+                              (uint32_t *)(keys + cnt) + nbmax + 1,
+                              (uint32_t *)(keys + cnt) + nbmax*2 + 1,
+                              (uint32_t *)(keys + cnt) + nbmax*2 + 1 + cnt)) {
+            rc = false;
+            break;
+        }
+    }
+
+    m->fn_free(keys);
+    return rc;
+}
+
+/* generate lvl2 hash table for slot i at p (len entries, or groups if
+ * MCDB_FLAG_SWISS), writing directly to mmap
+ * (slots are independent; called concurrently by mcdb_make_fill_thread()) */
+static void
+mcdb_make_fill(const struct mcdb_make * const restrict m, const uint32_t i,
+               char * const restrict p, const uint32_t len,
+               const uint32_t b, const uint32_t shift)
+  __attribute_nonnull__;
+
+static void
+mcdb_make_fill(const struct mcdb_make * const restrict m, const uint32_t i,
+               char * const restrict p, const uint32_t len,
+               const uint32_t b, const uint32_t shift)
+{
+    uint32_t u;
+    memset(p, 0, (size_t)len << shift);
+    if (shift == MCDB_SWISS_SHIFT)
+        mcdb_make_swiss(m->head[i], len, p, b);
+    else if (m->insert == MCDB_MAKE_INSERT_ROBINHOOD) {
+        const uint64_t dmask = (m->flags & MCDB_FLAG_KEYFP)
+          ? MCDB_DPOS48_MASK
+          : ~(uint64_t)0;
+        for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
+            for (uint32_t w = 0; w < x->num; ++w)
+                mcdb_make_robinhood(p, len, b, MCDB_SLOT_BITS, dmask,
+                                    x->hp+w);
+        }
+    }
+    else if (b == 3) { /* data section ends < 4 GB; use 32-bit dpos offset */
+        /* layout in memory: 4-byte khash, 4-byte dpos */
+        for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
+            const struct mcdb_hp * restrict hp = x->hp;
+            char * restrict q;
+            for (uint32_t w = x->num; w; --w, ++hp) {
+                q = p+4;  /*(4 is offset of dpos)*/
+                u = (hp->h >> MCDB_SLOT_BITS) % len;
+                /* find empty entry in open hash table (dpos == 0) */
+                while (*(uint32_t *)(q+((uintptr_t)u<<3)))
+                    if (++u == len)
+                        u = 0;
+                q += (u<<3);
+                uint32_strpack_bigendian_aligned_macro(q-4,hp->h); /*khash*/
+                uint32_strpack_bigendian_aligned_macro(q,(uint32_t)hp->p);
+            }                                                      /*dpos*/
+        }
+    }
+    else {/*b==4*//* data section crosses 4 GB; need 64-bit dpos offset */
+        /* layout in memory: 4-byte khash, 4-byte klen, 8-byte dpos */
+        /* (MCDB_FLAG_KEYFP: 2-byte key fingerprint, 6-byte dpos) */
+        for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
+            const struct mcdb_hp * restrict hp = x->hp;
+            char * restrict q;
+            for (uint32_t w = x->num; w; --w, ++hp) {
+                q = p+8;  /*(8 is offset of dpos)*/
+                u = (hp->h >> MCDB_SLOT_BITS) % len;
+                /* find empty entry in open hash table (dpos == 0) */
+                while (*(uintptr_t *)(q+((uintptr_t)u<<4)))
+                    if (++u == len)
+                        u = 0;
+                q += (u<<4);
+                uint32_strpack_bigendian_aligned_macro(q-8,hp->h); /*khash*/
+                uint32_strpack_bigendian_aligned_macro(q-4,hp->l); /*klen*/
+                uint64_strpack_bigendian_aligned_macro(q,(uint64_t)hp->p);
+            }                                                      /*dpos*/
+        }
+    }
+}
+
+#ifdef _THREAD_SAFE
+
+#include <pthread.h>
+
+#define MCDB_MAKE_THREADS_MAX 64
+
+struct mcdb_make_fill_ctx {
+  const struct mcdb_make *m;
+  uint32_t b;
+  uint32_t shift;
+  volatile uint32_t next;          /* next slot to fill */
+  uint32_t len[MCDB_SLOTS];
+  uintptr_t off[MCDB_SLOTS];       /* offset of hash table in m->map */
+};
+
+static void *
+mcdb_make_fill_thread(void * const arg)
+{
+    struct mcdb_make_fill_ctx * const restrict ctx = arg;
+    uint32_t i;
+    while ((i = __sync_fetch_and_add(&ctx->next, 1)) < MCDB_SLOTS)
+        mcdb_make_fill(ctx->m, i, ctx->m->map + ctx->off[i], ctx->len[i],
+                       ctx->b, ctx->shift);
+    return NULL;
+}
+
+/* size all lvl2 hash tables up front, mmap space for all tables at once,
+ * and fill slots concurrently on m->threads threads (calling thread is one)
+ * (output is identical to that of serial loop in mcdb_make_finish()) */
+static bool  __attribute_noinline__
+mcdb_make_fill_parallel(struct mcdb_make * const restrict m,
+                        char * const restrict header,
+                        const uint32_t b, const uint32_t shift)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static bool  __attribute_noinline__
+mcdb_make_fill_parallel(struct mcdb_make * const restrict m,
+                        char * const restrict header,
+                        const uint32_t b, const uint32_t shift)
+{
+    const uint32_t * const restrict count = m->count;
+    const uint32_t nthreads = m->threads < MCDB_MAKE_THREADS_MAX
+      ? m->threads
+      : MCDB_MAKE_THREADS_MAX;
+    pthread_t threads[MCDB_MAKE_THREADS_MAX];
+    struct mcdb_make_fill_ctx ctx;
+    uintptr_t d = m->pos;
+    uint32_t n = 0;
+    uint32_t i;
+    char *p;
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        ctx.len[i] = (shift == MCDB_SWISS_SHIFT)
+          ? mcdb_swiss_groups(count[i], b)
+          : mcdb_make_hslots(count[i], m->hslots_pct);
+        /* constant header (16 bytes per header slot, so multiply by 16) */
+        p = header + (i << 4);  /* (i << 4) == (i * 16) */
+        uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
+        uint32_strpack_bigendian_aligned_macro(p+8,ctx.len[i]);/* hslots */
+        *(uint32_t *)(p+12) = 0;     /*(fill hole with 0 only for consistency)*/
+        ctx.off[i] = d;
+        d += ((uintptr_t)ctx.len[i] << shift);
+    }
+
+    /* mmap sufficient space into which to write all hash tables */
+    if (m->offset+m->msz < d && !mcdb_mmap_upsize(m, d, false))
+        return false;
+    for (i = 0; i < MCDB_SLOTS; ++i)
+        ctx.off[i] -= m->offset;
+    m->pos = d;
+
+    ctx.m     = m;
+    ctx.b     = b;
+    ctx.shift = shift;
+    ctx.next  = 0;
+    for (; n < nthreads - 1; ++n) {
+        if (pthread_create(&threads[n], NULL, mcdb_make_fill_thread, &ctx) != 0)
+            break;  /*(continue with threads created)*/
+    }
+    (void)mcdb_make_fill_thread(&ctx);
+    for (i = 0; i < n; ++i)
+        (void)pthread_join(threads[i], NULL);
+    return true;
+}
+
+#endif
+
 int
 mcdb_make_finish(struct mcdb_make * const restrict m)
 {
@@ -468,25 +1328,39 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
     uintptr_t d;
     uint32_t len;
     uint32_t b;
+    uint32_t shift;
+    uint32_t nrecs;
+    uint64_t eod;
     char *p;
     const uint32_t * const restrict count = m->count;
     char header[MCDB_HEADER_SZ];
     if (m->map == MAP_FAILED)                  return mcdb_make_err(m,EPERM);
+    if (m->shards != NULL && !mcdb_make_shards_merge(m))
+                                               return mcdb_make_err(m,errno);
 
     for (u = 0, i = 0; i < MCDB_SLOTS; ++i)
         u += count[i];  /* no overflow; limited in mcdb_hplist_alloc */
 
     /* check for integer overflow and that sufficient space allocated in file */
     if (u > INT_MAX)                           return mcdb_make_err(m,ENOMEM);
+    if ((uint64_t)u * m->hslots_pct / 100 > UINT_MAX)
+                                               return mcdb_make_err(m,ENOMEM);
+    nrecs = u;
   #if !defined(_LP64) && !defined(__LP64__)
-    if (u > (UINT_MAX>>4))                     return mcdb_make_err(m,ENOMEM);
-    u <<= 4;  /* 8 byte hash entries in 32-bit; x 2 for space in table */
+    u = mcdb_make_hslots(u, m->hslots_pct);
+    if (u > (UINT_MAX>>3))                     return mcdb_make_err(m,ENOMEM);
+    u <<= 3;  /* 8 byte hash entries in 32-bit; x hslots_pct for table */
     if (m->pos > ((size_t)UINT_MAX-u))         return mcdb_make_err(m,ENOMEM);
   #endif
 
     /* add "hole" for alignment; incompatible with djb cdbdump */
     /* padding to align hash tables to MCDB_PAD_ALIGN bytes (16) */
-    d = (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK)) & MCDB_PAD_MASK;
+    /* (MCDB_FLAG_SWISS: align hash tables to 64 bytes (cache line)) */
+    eod = (uint64_t)m->pos;  /* end of data records */
+    d = (m->flags & MCDB_FLAG_SWISS)
+      ? ((1u << MCDB_SWISS_SHIFT) - (m->pos & ((1u << MCDB_SWISS_SHIFT)-1)))
+        & ((1u << MCDB_SWISS_SHIFT)-1)
+      : (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK)) & MCDB_PAD_MASK;
   #if !defined(_LP64) && !defined(__LP64__)
     if (d > (UINT_MAX-(m->pos+u)))             return mcdb_make_err(m,ENOMEM);
   #endif
@@ -499,14 +1373,41 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
      * (madvise is supposed to be advice, not promise; Solaris crash is bug) */
     posix_madvise(m->map, m->msz, POSIX_MADV_NORMAL);
 
-    b = (m->pos < UINT_MAX) ? 3u : 4u;
-    for (i = 0; i < MCDB_SLOTS; ++i) {
-        len = count[i] << 1;
+    /* (MCDB_FLAG_KEYFP: 16-byte entries (b==4) w/ klen and key fingerprint) */
+    if ((m->flags & MCDB_FLAG_KEYFP) && (uint64_t)m->pos > MCDB_DPOS48_MASK)
+        return mcdb_make_err(m,EFBIG);
+    b = (m->pos < UINT_MAX && !(m->flags & MCDB_FLAG_KEYFP)) ? 3u : 4u;
+
+    /* (MCDB_FLAG_MPH: perfect hash index instead of open hash tables) */
+    /* (MCDB_FLAG_SLOTS: hash tables for 2^slot_bits lvl1 slots) */
+    if (m->flags & (MCDB_FLAG_MPH|MCDB_FLAG_SLOTS)) {
+        if (!((m->flags & MCDB_FLAG_MPH)
+              ? mcdb_make_mph_slots(m, header, b)
+              : mcdb_make_slots_ext(m, header, b)))
+            return mcdb_make_err(m,errno);
+        i = MCDB_SLOTS;
+    }
+    else
+        i = 0;
+
+    /* (MCDB_FLAG_SWISS: len is num of 64-byte groups instead of entries) */
+    shift = (m->flags & MCDB_FLAG_SWISS) ? MCDB_SWISS_SHIFT : b;
+  #ifdef _THREAD_SAFE
+    if (m->threads > 1 && i == 0) {
+        if (!mcdb_make_fill_parallel(m, header, b, shift))
+            return mcdb_make_err(m,errno);
+        i = MCDB_SLOTS;
+    }
+  #endif
+    for (; i < MCDB_SLOTS; ++i) {
+        len = (shift == MCDB_SWISS_SHIFT)
+          ? mcdb_swiss_groups(count[i], b)
+          : mcdb_make_hslots(count[i], m->hslots_pct);
         d   = m->pos;
 
         /* mmap sufficient space into which to write hash table for this slot */
-        if (m->offset+m->msz < d+((uintptr_t)len << b)
-            && !mcdb_mmap_upsize(m, d+((uintptr_t)len << b), false))
+        if (m->offset+m->msz < d+((uintptr_t)len << shift)
+            && !mcdb_mmap_upsize(m, d+((uintptr_t)len << shift), false))
             break;
 
         /* constant header (16 bytes per header slot, so multiply by 16) */
@@ -517,48 +1418,29 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
 
         /* generate hash table for slot, writing directly to mmap */
         p = m->map + m->pos - m->offset;
-        m->pos += ((uintptr_t)len << b);
-        memset(p, 0, (size_t)len << b);
-        if (b == 3) { /* data section ends < 4 GB; use 32-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+4;  /*(4 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uint32_t *)(q+((uintptr_t)u<<3)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<3);
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q,(uint32_t)hp->p);
-                }                                                      /*dpos*/
-            }
-        }
-        else {/*b==4*//* data section crosses 4 GB; need 64-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte klen, 8-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+8;  /*(8 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uintptr_t *)(q+((uintptr_t)u<<4)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<4);
-                    uint32_strpack_bigendian_aligned_macro(q-8,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->l); /*klen*/
-                    uint64_strpack_bigendian_aligned_macro(q,(uint64_t)hp->p);
-                }                                                      /*dpos*/
-            }
-        }
+        m->pos += ((uintptr_t)len << shift);
+        mcdb_make_fill(m, i, p, len, b, shift);
+    }
+
+    /* header fields (stored in padding of lvl1 slot headers) */
+  #define mcdb_hdr_field_pack(f,v) \
+    uint32_strpack_bigendian_aligned_macro(header+mcdb_hdr_field_offset(f),(v))
+    if (m->hash_id != MCDB_HASH_DJB) {
+        mcdb_hdr_field_pack(MCDB_HDR_HASH_ID,   m->hash_id);
+        mcdb_hdr_field_pack(MCDB_HDR_HASH_INIT, m->hash_init);
     }
+    mcdb_hdr_field_pack(MCDB_HDR_MAGIC,   MCDB_HDR_MAGIC_V2);
+    mcdb_hdr_field_pack(MCDB_HDR_VERSION, MCDB_VERSION);
+    mcdb_hdr_field_pack(MCDB_HDR_FLAGS,   m->flags);
+    mcdb_hdr_field_pack(MCDB_HDR_B,       b);
+    mcdb_hdr_field_pack(MCDB_HDR_NRECS,   nrecs);
+    mcdb_hdr_field_pack(MCDB_HDR_EOD_HI,  (uint32_t)(eod >> 32));
+    mcdb_hdr_field_pack(MCDB_HDR_EOD_LO,  (uint32_t)eod);
+    if (m->flags & MCDB_FLAG_SLOTS)
+        mcdb_hdr_field_pack(MCDB_HDR_SLOT_BITS, m->slot_bits);
+    mcdb_hdr_field_pack(MCDB_HDR_GEN_HI,  (uint32_t)(m->gen >> 32));
+    mcdb_hdr_field_pack(MCDB_HDR_GEN_LO,  (uint32_t)m->gen);
+  #undef mcdb_hdr_field_pack
 
     u = (uint32_t)(i == MCDB_SLOTS && mcdb_mmap_commit(m, header));
     return (u ? 0 : -1) | mcdb_make_destroy(m);
@@ -586,9 +1468,10 @@ mcdb_make_destroy(struct mcdb_make * const restrict m)
             rc |= nointr_ftruncate(m->fd, (off_t)m->pos);
       #endif
     }
-    if (m->head[0] != NULL) {
+    if (m->head[0] != NULL) {  /*(m->shards set in mcdb_make_start())*/
         struct mcdb_hplist *n;
         struct mcdb_hplist *node;
+        mcdb_make_shards_free(m);
         node = m->head[0]->pend;
         while ((n = node)) {
             node = node->pend;
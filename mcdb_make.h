@@ -37,13 +37,66 @@ extern "C" {
 
 struct mcdb_hp { uintptr_t p; uint32_t h; uint32_t l; }; /*(private structure)*/
 struct mcdb_hplist;                                      /*(private structure)*/
+struct mcdb_make_shard;                                  /*(private structure)*/
+
+/* mcdb creation options (zero-initialized struct selects defaults) */
+struct mcdb_make_opts {
+  uint32_t hash_id;           /* hash func id (enum mcdb_hash_id) */
+  uint32_t hash_seed;         /* hash init value (ignored for MCDB_HASH_DJB) */
+  uint32_t flags;             /* feature flags (enum mcdb_hdr_flags) */
+  uint32_t hslots_pct;        /* lvl2 hash table entries per 100 records
+                               * (0 selects default MCDB_MAKE_HSLOTS_PCT) */
+  uint32_t insert;            /* hash table insertion (enum mcdb_make_insert)*/
+  uint32_t slot_bits;         /* lvl1 slot bits (0 selects MCDB_SLOT_BITS (8))
+                               * (9 - MCDB_SLOT_BITS_MAX sets MCDB_FLAG_SLOTS) */
+  uint64_t gen;               /* mcdb generation stored in header (0: none) */
+  uint32_t threads;           /* threads filling lvl2 hash tables in
+                               * mcdb_make_finish() (0 or 1: single thread)
+                               * (open hash table and MCDB_FLAG_SWISS layouts;
+                               *  requires _THREAD_SAFE; max 64)
+                               * (also threads parsing mmap'd input in
+                               *  mcdb_makefmt_fdintofd_opts()) */
+  uint32_t input;             /* mcdb_makefmt input format
+                               * (enum mcdb_make_input) */
+};
+
+/* lvl2 open hash table insertion (no format change; readers probe linearly)
+ * MCDB_MAKE_INSERT_ROBINHOOD: entry farther from its home entry displaces
+ * entry nearer to its home entry, evening out probe lengths; entries with the
+ * same home entry are placed in dpos (insertion) order */
+enum mcdb_make_insert {
+  MCDB_MAKE_INSERT_LINEAR    = 0,
+  MCDB_MAKE_INSERT_ROBINHOOD = 1
+};
+
+/* mcdb_makefmt input format
+ * MCDB_MAKE_INPUT_CDB: cdbmake "+klen,dlen:key->data\n" ... blank line ends
+ * MCDB_MAKE_INPUT_BIN_LE, MCDB_MAKE_INPUT_BIN_BE: binary records of 4-byte
+ *   klen, 4-byte dlen (little-endian or big-endian), key, data; end of input
+ *   at record boundary ends input
+ * MCDB_MAKE_INPUT_BIN_HASH: (with _BIN_LE or _BIN_BE) 4-byte key hash follows
+ *   dlen; must be key hash from mcdb hash func and seed (hash_id, hash_seed)
+ *   (not verified; used for records buffered whole, else key is rehashed) */
+enum mcdb_make_input {
+  MCDB_MAKE_INPUT_CDB      = 0,
+  MCDB_MAKE_INPUT_BIN_LE   = 1,
+  MCDB_MAKE_INPUT_BIN_BE   = 2,
+  MCDB_MAKE_INPUT_BIN_HASH = 4
+};
+
+/* lvl2 hash table size (open hash table layout; not MPH or SWISS):
+ * 200 (2x records; 50% load) by default, from 125 (80% load) to 400 (25% load)
+ * (smaller tables trade index size for longer probe sequences) */
+#define MCDB_MAKE_HSLOTS_PCT     200u
+#define MCDB_MAKE_HSLOTS_PCT_MIN 125u
+#define MCDB_MAKE_HSLOTS_PCT_MAX 400u
 
 struct mcdb_make {
   size_t pos;
   size_t offset;
   char * restrict map;
   uint32_t hash_init;         /* hash init value */
-  uint32_t hash_pad;          /* (padding)*/
+  uint32_t hash_id;           /* hash func id (enum mcdb_hash_id) */
   uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
   size_t fsz;
   size_t osz;
@@ -56,6 +109,13 @@ struct mcdb_make {
   char *fntmp; /*(compiler warning for const char * restrict passed to free())*/
   int fd;
   mode_t st_mode;
+  uint32_t flags;             /* feature flags (enum mcdb_hdr_flags) */
+  uint32_t hslots_pct;        /* lvl2 hash table entries per 100 records */
+  uint32_t insert;            /* hash table insertion (enum mcdb_make_insert)*/
+  uint32_t slot_bits;         /* lvl1 slot bits */
+  uint64_t gen;               /* mcdb generation */
+  uint32_t threads;           /* threads filling lvl2 hash tables */
+  struct mcdb_make_shard *shards; /* merged in mcdb_make_finish() */
   uint32_t count[MCDB_SLOTS];
   struct mcdb_hplist *head[MCDB_SLOTS];
 };
@@ -64,6 +124,8 @@ struct mcdb_make {
 /*
  * Note: mcdb *_make_* routines are not thread-safe
  * (no need for thread-safety; mcdb is typically created from a single stream)
+ * (exception: mcdb_make_shard_add() on different shards may run concurrently,
+ *  and concurrently with mcdb_make_add*() on mcdb_make)
  */
 
 
@@ -71,12 +133,36 @@ extern int
 mcdb_make_start(struct mcdb_make * restrict, int,
                 void * (*)(size_t), void (*)(void *))
   __attribute_nonnull__  __attribute_warn_unused_result__;
+/* set options; call after mcdb_make_start() and before first add */
+extern int
+mcdb_make_setopts(struct mcdb_make * restrict,
+                  const struct mcdb_make_opts * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 extern int
 mcdb_make_add(struct mcdb_make * restrict,
               const char * restrict, size_t,
               const char * restrict, size_t)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 extern int
+mcdb_make_add_hashed(struct mcdb_make * restrict,
+                     const char * restrict, size_t,
+                     const char * restrict, size_t, uint32_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+/* mcdb_make_shard_create(): shard for records from one producer (thread)
+ * Call after mcdb_make_setopts() and before producers start; not thread-safe.
+ * mcdb_make_shard_add() copies record into shard (memory allocated with
+ * fn_malloc) and hashes key.  mcdb_make_finish() appends records of shards,
+ * in order shards were created, after records added with mcdb_make_add*(),
+ * and frees shards.  (see mcdb_make_destroy() upon error) */
+extern struct mcdb_make_shard *
+mcdb_make_shard_create(struct mcdb_make * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+extern int
+mcdb_make_shard_add(struct mcdb_make_shard * restrict,
+                    const char * restrict, size_t,
+                    const char * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+extern int
 mcdb_make_finish(struct mcdb_make * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 extern int
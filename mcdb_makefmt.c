@@ -51,12 +51,14 @@
 #include "mcdb_error.h"
 #include "nointr.h"
 #include "code_attributes.h"
+#include "uint32.h"
 
 #include <errno.h>
 #include <sys/mman.h>  /* mmap(), munmap() */
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>     /* open() */
+#include <limits.h>    /* INT_MAX */
 #include <stdbool.h>   /* bool */
 #include <stdlib.h>    /* EXIT_SUCCESS */
 #include <string.h>    /* memcpy(), memmove(), memchr() */
@@ -162,6 +164,12 @@ mcdb_bufread_number (struct mcdb_input * const restrict b,
     return false; /*error: no digits or too large; not bothering to set ERANGE*/
 }
 
+/* Note: preamble is parsed byte by byte on purpose.  Lens of consecutive
+ * records typically have the same number of digits, so the branches below are
+ * predicted and the next record is located speculatively.  Vectorized (SSE2)
+ * and SWAR preamble decoding were measured 2x-3x slower: each record's start
+ * then depends on data (delimiter bitmask -> ctz -> lens) instead of on
+ * predicted branches.  (see t/PERFORMANCE) */
 static int
 mcdb_bufread_preamble (struct mcdb_input * const restrict b,
                        size_t * const restrict klen,
@@ -240,21 +248,421 @@ mcdb_bufread_rec (struct mcdb_make * const restrict m,
                && b->buf[b->pos++] == '\n'   );
 }
 
+/* binary input (MCDB_MAKE_INPUT_BIN_LE or MCDB_MAKE_INPUT_BIN_BE)
+ * "kkkkddddxxxxyyyy" or "kkkkddddhhhhxxxxyyyy" (MCDB_MAKE_INPUT_BIN_HASH)
+ *   kkkk = 4-byte key len
+ *   dddd = 4-byte data len
+ *   hhhh = 4-byte key hash
+ *   xxxx = key string
+ *   yyyy = data string
+ * end of input at record boundary ends input */
+static int  __attribute_noinline__
+mcdb_bufread_bin (struct mcdb_make * const restrict m,
+                  struct mcdb_input * const restrict b,
+                  const uint32_t input)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_bufread_bin (struct mcdb_make * const restrict m,
+                  struct mcdb_input * const restrict b,
+                  const uint32_t input)
+{
+    const size_t hdrsz = (input & MCDB_MAKE_INPUT_BIN_HASH) ? 12 : 8;
+    const unsigned char *h;
+    const char *p;
+    size_t klen;
+    size_t dlen;
+    uint32_t khash = 0;
+
+    if (input > (MCDB_MAKE_INPUT_BIN_BE|MCDB_MAKE_INPUT_BIN_HASH)
+        || (input & (MCDB_MAKE_INPUT_BIN_LE|MCDB_MAKE_INPUT_BIN_BE)) == 0
+        || (input & (MCDB_MAKE_INPUT_BIN_LE|MCDB_MAKE_INPUT_BIN_BE))
+             == (MCDB_MAKE_INPUT_BIN_LE|MCDB_MAKE_INPUT_BIN_BE))
+        return MCDB_ERROR_USAGE;
+
+    for (;;) {
+        if (b->datasz - b->pos < hdrsz
+            && (errno = 0, !mcdb_bufread_xchars(b, hdrsz)))
+            return (errno != 0)
+              ? MCDB_ERROR_READ
+              : (b->datasz == b->pos)
+                ? EXIT_SUCCESS                 /*  0  done; EXIT_SUCCESS */
+                : MCDB_ERROR_READFORMAT;       /* -1  truncated record   */
+
+        h = (const unsigned char *)b->buf + b->pos;
+        if (input & MCDB_MAKE_INPUT_BIN_BE) {
+            klen = uint32_strunpack_bigendian_macro(h);
+            dlen = uint32_strunpack_bigendian_macro(h+4);
+            if (hdrsz == 12)
+                khash = uint32_strunpack_bigendian_macro(h+8);
+        }
+        else {
+            klen = uint32_strunpack_macro(h);
+            dlen = uint32_strunpack_macro(h+4);
+            if (hdrsz == 12)
+                khash = uint32_strunpack_macro(h+8);
+        }
+        b->pos += hdrsz;
+        if (klen > INT_MAX-8 || dlen > INT_MAX-8) /*(const db element limit)*/
+            return MCDB_ERROR_READFORMAT;
+
+        /* optimized frequent path: entire record buffered and available */
+        if (klen + dlen <= b->datasz - b->pos) {
+            p = b->buf + b->pos;
+            if ((hdrsz == 12
+                 ? mcdb_make_add_hashed(m, p, klen, p+klen, dlen, khash)
+                 : mcdb_make_add_h(m, p, klen, p+klen, dlen)) != 0)
+                return MCDB_ERROR_WRITE;
+            b->pos += klen + dlen;
+        }
+        else { /* entire record is not buffered; handle in parts */
+            /* (key hash is streamed; precomputed key hash not used) */
+            if (mcdb_make_addbegin_h(m, klen, dlen) != 0)
+                return MCDB_ERROR_WRITE;
+            if (mcdb_bufread_str(b, klen, m, mcdb_make_addbuf_key_h)
+                && mcdb_bufread_str(b, dlen, m, mcdb_make_addbuf_data_h))
+                mcdb_make_addend_h(m);
+            else
+                return (errno == 0 ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ);
+        }
+    }
+}
+
+#ifdef _THREAD_SAFE
+
+#include <pthread.h>
+
+/* parallel parse of mmap'd input (fd == -1)
+ *
+ * Input is split into chunks at probable record boundaries.  A boundary is
+ * only probable since "\n+nnnn,mmmm:" might also appear inside data; it is
+ * confirmed once the preceding chunk has been parsed and ends exactly on it.
+ * Threads parse, validate, and hash keys of chunks.  The calling thread adds
+ * records of each confirmed chunk to mcdb_make in input order (preserving the
+ * order of duplicate keys), and reparses serially any input between a true
+ * record boundary and the next probable boundary (unconfirmed chunk).
+ */
+
+#define MCDB_MAKEFMT_THREADS_MAX 64
+#define MCDB_MAKEFMT_CHUNKSZ_MIN (64u*1024)
+#define MCDB_MAKEFMT_CHUNKSZ_MAX (16u*1024*1024)
+#define MCDB_MAKEFMT_SYNC_RECS 8  /* well-formed recs to accept boundary */
+
+struct mcdb_makefmt_rec {
+  const char *k;
+  uint32_t klen;
+  uint32_t dlen;
+  uint32_t h;
+};
+
+struct mcdb_makefmt_chunk {
+  struct mcdb_makefmt_rec *recs;
+  size_t nrecs;
+  size_t start;                    /* probable record boundary */
+  size_t end;                      /* pos at which parse stopped */
+  int rv;                          /* 1 more input, 0 end of input, < 0 err */
+  bool done;
+};
+
+struct mcdb_makefmt_par {
+  char *buf;
+  size_t sz;
+  struct mcdb_makefmt_chunk *chunks;
+  size_t nchunks;
+  size_t next;                     /* next chunk to parse */
+  size_t added;                    /* chunks consumed by calling thread */
+  size_t ahead;                    /* max chunks parsed ahead of consumer */
+  bool stop;
+  uint32_t hash_init;
+  uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t);
+  void * (*fn_malloc)(size_t);
+  void (*fn_free)(void *);
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+/* parse and validate entire record in mmap'd input (fd == -1) */
+static int
+mcdb_makefmt_parse_rec (struct mcdb_input * const restrict b,
+                        const char ** const restrict k,
+                        size_t * const restrict klen,
+                        size_t * const restrict dlen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_makefmt_parse_rec (struct mcdb_input * const restrict b,
+                        const char ** const restrict k,
+                        size_t * const restrict klen,
+                        size_t * const restrict dlen)
+{
+    int rv = mcdb_bufread_preamble(b, klen, dlen);
+    if (rv > 0) {
+        /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
+        const char * const p = *k = b->buf + b->pos;
+        if (*klen + *dlen + 3 <= b->datasz - b->pos
+            && p[*klen] == '-' && p[*klen+1] == '>' && p[*klen+2+*dlen]=='\n')
+            b->pos += *klen + *dlen + 3;
+        else
+            rv = MCDB_ERROR_READFORMAT;
+    }
+    return rv;
+}
+
+/* find probable record boundary after pos: start of line beginning a run of
+ * MCDB_MAKEFMT_SYNC_RECS well-formed records (or well-formed end of input) */
+static size_t
+mcdb_makefmt_sync (char * const restrict buf, const size_t sz, size_t pos)
+  __attribute_nonnull__;
+static size_t
+mcdb_makefmt_sync (char * const restrict buf, const size_t sz, size_t pos)
+{
+    struct mcdb_input b = { buf, 0, sz, sz, -1 };
+    const char *p;
+    size_t klen;
+    size_t dlen;
+    int n;
+    int rv;
+    while (pos < sz && (p = memchr(buf+pos, '\n', sz-pos)) != NULL) {
+        b.pos = pos = (size_t)(p - buf) + 1;
+        n = 0;
+        while ((rv = mcdb_makefmt_parse_rec(&b, &p, &klen, &dlen)) > 0
+               && ++n < MCDB_MAKEFMT_SYNC_RECS)
+            ;
+        if (rv >= 0)
+            return pos;
+    }
+    return sz;
+}
+
+static void
+mcdb_makefmt_parse_chunk (struct mcdb_makefmt_par * const restrict par,
+                          struct mcdb_makefmt_chunk * const restrict c,
+                          const size_t end)
+  __attribute_nonnull__;
+static void
+mcdb_makefmt_parse_chunk (struct mcdb_makefmt_par * const restrict par,
+                          struct mcdb_makefmt_chunk * const restrict c,
+                          const size_t end)
+{
+    struct mcdb_input b = { par->buf, c->start, par->sz, par->sz, -1 };
+    struct mcdb_makefmt_rec *recs = NULL;
+    struct mcdb_makefmt_rec *r;
+    const char *k;
+    size_t klen;
+    size_t dlen;
+    size_t n = 0;
+    size_t sz = 0;
+    int rv = 1;
+
+    while (b.pos < end
+           && (rv = mcdb_makefmt_parse_rec(&b, &k, &klen, &dlen)) > 0) {
+        if (n == sz) {  /* (fn_malloc and fn_free; no fn_realloc) */
+            sz = (sz != 0) ? sz << 1 : 1024;
+            r = par->fn_malloc(sz * sizeof(struct mcdb_makefmt_rec));
+            if (r == NULL) { rv = MCDB_ERROR_MALLOC; break; }
+            if (recs != NULL) {
+                memcpy(r, recs, n * sizeof(struct mcdb_makefmt_rec));
+                par->fn_free(recs);
+            }
+            recs = r;
+        }
+        r = recs + n++;
+        r->k    = k;
+        r->klen = (uint32_t)klen;
+        r->dlen = (uint32_t)dlen;
+        r->h    = par->hash_fn(par->hash_init, k, klen);
+    }
+
+    c->recs  = recs;
+    c->nrecs = n;
+    c->end   = b.pos;
+    c->rv    = rv;
+}
+
+static void *
+mcdb_makefmt_parse_thread (void * const arg)
+{
+    struct mcdb_makefmt_par * const restrict par = arg;
+    struct mcdb_makefmt_chunk *c;
+    size_t i;
+    errno = 0;  /*(mcdb_bufread_preamble() checks errno)*/
+    pthread_mutex_lock(&par->mutex);
+    while (!par->stop && (i = par->next) < par->nchunks) {
+        if (i - par->added >= par->ahead) { /* bound memory used for recs */
+            pthread_cond_wait(&par->cond, &par->mutex);
+            continue;
+        }
+        par->next = i + 1;
+        pthread_mutex_unlock(&par->mutex);
+        c = par->chunks + i;
+        mcdb_makefmt_parse_chunk(par, c, i+1 < par->nchunks
+                                         ? par->chunks[i+1].start
+                                         : par->sz);
+        pthread_mutex_lock(&par->mutex);
+        c->done = true;
+        pthread_cond_broadcast(&par->cond);
+    }
+    pthread_mutex_unlock(&par->mutex);
+    return NULL;
+}
+
+/* returns 1 if input remains to be parsed serially from b->pos,
+ * 0 (EXIT_SUCCESS) at end of input, or < 0 on error */
+static int  __attribute_noinline__
+mcdb_makefmt_parse_parallel (struct mcdb_make * const restrict m,
+                             struct mcdb_input * const restrict b,
+                             uint32_t nthreads)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_makefmt_parse_parallel (struct mcdb_make * const restrict m,
+                             struct mcdb_input * const restrict b,
+                             uint32_t nthreads)
+{
+    pthread_t threads[MCDB_MAKEFMT_THREADS_MAX];
+    struct mcdb_makefmt_par par;
+    struct mcdb_makefmt_chunk *c;
+    const struct mcdb_makefmt_rec *r;
+    const char *k;
+    size_t chunksz;
+    size_t klen;
+    size_t dlen;
+    size_t end;
+    size_t pos = b->pos;
+    size_t i;
+    size_t j;
+    uint32_t n = 0;
+    int rv = 1;
+
+    if (nthreads > MCDB_MAKEFMT_THREADS_MAX)
+        nthreads = MCDB_MAKEFMT_THREADS_MAX;
+    chunksz = (b->datasz - pos) / (nthreads << 3);
+    if (chunksz < MCDB_MAKEFMT_CHUNKSZ_MIN)
+        chunksz = MCDB_MAKEFMT_CHUNKSZ_MIN;
+    else if (chunksz > MCDB_MAKEFMT_CHUNKSZ_MAX)
+        chunksz = MCDB_MAKEFMT_CHUNKSZ_MAX;
+    par.nchunks = (b->datasz - pos + chunksz - 1) / chunksz;
+    if (par.nchunks < 2)
+        return 1;  /* parse serially */
+    par.chunks = m->fn_malloc(par.nchunks * sizeof(struct mcdb_makefmt_chunk));
+    if (par.chunks == NULL)
+        return 1;  /* parse serially */
+
+    /* probable record boundaries (serial, but typically few recs per chunk) */
+    for (i = 0, end = pos; i < par.nchunks; ++i) {
+        c = par.chunks + i;
+        if (i != 0) {
+            j = pos + i * chunksz;
+            end = mcdb_makefmt_sync(b->buf, b->datasz, j > end ? j : end);
+        }
+        c->recs  = NULL;
+        c->nrecs = 0;
+        c->start = end;
+        c->end   = end;
+        c->rv    = 1;
+        c->done  = false;
+    }
+
+    par.buf       = b->buf;
+    par.sz        = b->datasz;
+    par.next      = 0;
+    par.added     = 0;
+    par.ahead     = nthreads << 1;
+    par.stop      = false;
+    par.hash_init = m->hash_init;
+    par.hash_fn   = m->hash_fn;
+    par.fn_malloc = m->fn_malloc;
+    par.fn_free   = m->fn_free;
+    if (pthread_mutex_init(&par.mutex, NULL) != 0) {
+        m->fn_free(par.chunks);
+        return 1;  /* parse serially */
+    }
+    if (pthread_cond_init(&par.cond, NULL) != 0) {
+        pthread_mutex_destroy(&par.mutex);
+        m->fn_free(par.chunks);
+        return 1;  /* parse serially */
+    }
+    for (; n < nthreads; ++n) {
+        if (pthread_create(&threads[n],NULL,mcdb_makefmt_parse_thread,&par)!=0)
+            break;  /*(continue with threads created)*/
+    }
+
+    for (i = 0; n != 0 && i < par.nchunks && rv > 0; ++i) {
+        c = par.chunks + i;
+        pthread_mutex_lock(&par.mutex);
+        while (!c->done)
+            pthread_cond_wait(&par.cond, &par.mutex);
+        pthread_mutex_unlock(&par.mutex);
+
+        if (pos == c->start) {  /* chunk began on a record boundary */
+            for (j = 0, r = c->recs; j < c->nrecs; ++j, ++r) {
+                if (mcdb_make_add_hashed(m, r->k, r->klen,
+                                         r->k+r->klen+2, r->dlen, r->h) != 0) {
+                    rv = MCDB_ERROR_WRITE;
+                    break;
+                }
+            }
+            if (rv > 0) {
+                rv  = c->rv;
+                pos = c->end;
+            }
+        }
+        if (c->recs != NULL) {
+            m->fn_free(c->recs);
+            c->recs = NULL;
+        }
+
+        pthread_mutex_lock(&par.mutex);
+        par.added = i + 1;
+        pthread_cond_broadcast(&par.cond);
+        pthread_mutex_unlock(&par.mutex);
+
+        /* pos past chunk start (chunk did not begin on a record boundary);
+         * parse serially up to (or past) next probable record boundary */
+        end = (i+1 < par.nchunks) ? par.chunks[i+1].start : par.sz;
+        b->pos = pos;
+        while (rv > 0 && b->pos < end) {
+            rv = mcdb_makefmt_parse_rec(b, &k, &klen, &dlen);
+            if (rv > 0 && mcdb_make_add(m, k, klen, k+klen+2, dlen) != 0)
+                rv = MCDB_ERROR_WRITE;
+        }
+        pos = b->pos;
+    }
+
+    pthread_mutex_lock(&par.mutex);
+    par.stop = true;
+    pthread_cond_broadcast(&par.cond);
+    pthread_mutex_unlock(&par.mutex);
+    for (j = 0; j < n; ++j)
+        (void)pthread_join(threads[j], NULL);
+    for (j = 0; j < par.nchunks; ++j) {
+        if (par.chunks[j].recs != NULL)
+            m->fn_free(par.chunks[j].recs);
+    }
+    pthread_cond_destroy(&par.cond);
+    pthread_mutex_destroy(&par.mutex);
+    m->fn_free(par.chunks);
+
+    b->pos = pos;
+    return rv;
+}
+
+#endif
+
 
 /* Above are private data struct, static routines used by mcdb_makefmt_fdintofd
  *   struct mcdb_input
  *   mcdb_bufread_preamble()
  *   mcdb_bufread_rec()
+ *   mcdb_bufread_bin()
  */ 
 
 
 int  __attribute_noinline__
-mcdb_makefmt_fdintofd (const int inputfd,
-                       char * const restrict buf,
-                       const size_t bufsz,
-                       const int outputfd,
-                       void * (* const fn_malloc)(size_t),
-                       void (* const fn_free)(void *))
+mcdb_makefmt_fdintofd_opts (const int inputfd,
+                            char * const restrict buf,
+                            const size_t bufsz,
+                            const int outputfd,
+                            void * (* const fn_malloc)(size_t),
+                            void (* const fn_free)(void *),
+                            const struct mcdb_make_opts * const restrict opts)
 {
     struct mcdb_input b = { buf, 0, 0, bufsz, inputfd };
     struct mcdb_make m;
@@ -266,11 +674,24 @@ mcdb_makefmt_fdintofd (const int inputfd,
 
     if (mcdb_make_start(&m, outputfd, fn_malloc, fn_free) == -1)
         return MCDB_ERROR_WRITE;
+    if (opts != NULL && mcdb_make_setopts(&m, opts) == -1) {
+        mcdb_make_destroy(&m);
+        return MCDB_ERROR_WRITE;
+    }
 
     if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
         b.datasz = b.bufsz;
 
-    while ((rv = mcdb_bufread_preamble(&b,&klen,&dlen)) > 0) {
+    rv = 1;
+    if (opts != NULL && opts->input != MCDB_MAKE_INPUT_CDB)
+        rv = mcdb_bufread_bin(&m, &b, opts->input);
+  #ifdef _THREAD_SAFE
+    /* mmap'd input: parse, validate, hash keys on m.threads threads */
+    else if (b.fd == -1 && m.threads > 1)
+        rv = mcdb_makefmt_parse_parallel(&m, &b, m.threads);
+  #endif
+
+    while (rv > 0 && (rv = mcdb_bufread_preamble(&b,&klen,&dlen)) > 0) {
 
         /* optimized frequent path: entire data line buffered and available */
         /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
@@ -300,6 +721,18 @@ mcdb_makefmt_fdintofd (const int inputfd,
     }
 }
 
+int  __attribute_noinline__
+mcdb_makefmt_fdintofd (const int inputfd,
+                       char * const restrict buf,
+                       const size_t bufsz,
+                       const int outputfd,
+                       void * (* const fn_malloc)(size_t),
+                       void (* const fn_free)(void *))
+{
+    return mcdb_makefmt_fdintofd_opts(inputfd, buf, bufsz, outputfd,
+                                      fn_malloc, fn_free, NULL);
+}
+
 /* Examples:
  * - read from stdin:
  *     mcdb_makefmt_fdintofile(STDIN_FILENO,buf,BUFSZ,"fname.cdb",malloc,free);
@@ -316,15 +749,17 @@ mcdb_makefmt_fdintofd (const int inputfd,
  * and keeps interface simple for direct callers of mcdb_makefmt_fdintofd().
  */
 int  __attribute_noinline__
-mcdb_makefmt_fdintofile (const int inputfd,
-                         char * const restrict buf, const size_t bufsz,
-                         const char * const restrict fname,
-                         void * (* const fn_malloc)(size_t),
-                         void (* const fn_free)(void *))
+mcdb_makefmt_fdintofile_opts (const int inputfd,
+                              char * const restrict buf, const size_t bufsz,
+                              const char * const restrict fname,
+                              void * (* const fn_malloc)(size_t),
+                              void (* const fn_free)(void *),
+                              const struct mcdb_make_opts * const restrict opts)
 {
     struct mcdb_make m;
     int rv = mcdb_makefn_start(&m, fname, fn_malloc, fn_free) == 0
-      ? mcdb_makefmt_fdintofd(inputfd, buf, bufsz, m.fd, fn_malloc, fn_free)
+      ? mcdb_makefmt_fdintofd_opts(inputfd, buf, bufsz, m.fd,
+                                   fn_malloc, fn_free, opts)
       : (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
     if (rv == 0)
         rv = mcdb_makefn_finish(&m, true) == 0 ? 0 : MCDB_ERROR_WRITE;
@@ -333,10 +768,23 @@ mcdb_makefmt_fdintofile (const int inputfd,
 }
 
 int  __attribute_noinline__
-mcdb_makefmt_fileintofile (const char * const restrict infile,
-                           const char * const restrict fname,
-                           void * (* const fn_malloc)(size_t),
-                           void (* const fn_free)(void *))
+mcdb_makefmt_fdintofile (const int inputfd,
+                         char * const restrict buf, const size_t bufsz,
+                         const char * const restrict fname,
+                         void * (* const fn_malloc)(size_t),
+                         void (* const fn_free)(void *))
+{
+    return mcdb_makefmt_fdintofile_opts(inputfd, buf, bufsz, fname,
+                                        fn_malloc, fn_free, NULL);
+}
+
+int  __attribute_noinline__
+mcdb_makefmt_fileintofile_opts (const char * const restrict infile,
+                                const char * const restrict fname,
+                                void * (* const fn_malloc)(size_t),
+                                void (* const fn_free)(void *),
+                                const struct mcdb_make_opts *
+                                  const restrict opts)
 {
     void * restrict x = MAP_FAILED;
     int rv = MCDB_ERROR_READ;
@@ -361,8 +809,8 @@ mcdb_makefmt_fileintofile (const char * const restrict infile,
         posix_madvise(x, (size_t)st.st_size,
                       POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
         /* pass entire map and size as params; fd -1 elides read()/remaps */
-        rv = mcdb_makefmt_fdintofile(-1, x, (size_t)st.st_size,
-                                     fname, fn_malloc, fn_free);
+        rv = mcdb_makefmt_fdintofile_opts(-1, x, (size_t)st.st_size,
+                                          fname, fn_malloc, fn_free, opts);
     }
 
     if (x != MAP_FAILED)
@@ -372,3 +820,13 @@ mcdb_makefmt_fileintofile (const char * const restrict infile,
 
     return rv;
 }
+
+int  __attribute_noinline__
+mcdb_makefmt_fileintofile (const char * const restrict infile,
+                           const char * const restrict fname,
+                           void * (* const fn_malloc)(size_t),
+                           void (* const fn_free)(void *))
+{
+    return mcdb_makefmt_fileintofile_opts(infile, fname, fn_malloc, fn_free,
+                                          NULL);
+}
@@ -36,6 +36,8 @@
 extern "C" {
 #endif
 
+struct mcdb_make_opts;  /* mcdb_make.h; (NULL opts arg selects defaults) */
+
 /* Note: ensure output file is open() O_RDWR if calling mcdb_makefmt_fdintofd()
  * or else mmap() may fail.
  * Note: caller of mcdb_makefmt_fdintofd() should choose whether or not to then
@@ -56,6 +58,27 @@ mcdb_makefmt_fileintofile (const char * restrict, const char * restrict,
                            void * (*)(size_t), void (*)(void *))
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+/* *_opts() routines take struct mcdb_make_opts (mcdb_make.h) applied with
+ * mcdb_make_setopts() before input is read (routines above pass NULL) */
+
+int
+mcdb_makefmt_fdintofd_opts (int, char * restrict, size_t,
+                            int, void * (*)(size_t), void (*)(void *),
+                            const struct mcdb_make_opts * restrict)
+  __attribute_nonnull_x__((2,5,6))  __attribute_warn_unused_result__;
+
+int
+mcdb_makefmt_fdintofile_opts (const int, char * restrict, size_t,
+                              const char * restrict,
+                              void * (*)(size_t), void (*)(void *),
+                              const struct mcdb_make_opts * restrict)
+  __attribute_nonnull_x__((2,4,5,6))  __attribute_warn_unused_result__;
+int
+mcdb_makefmt_fileintofile_opts (const char * restrict, const char * restrict,
+                                void * (*)(size_t), void (*)(void *),
+                                const struct mcdb_make_opts * restrict)
+  __attribute_nonnull_x__((1,2,3,4))  __attribute_warn_unused_result__;
+
 #ifdef __cplusplus
 }
 #endif
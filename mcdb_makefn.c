@@ -28,6 +28,9 @@
 #ifndef _XOPEN_SOURCE /* >= 500 on Linux for mkstemp(), fchmod(), fdatasync() */
 #define _XOPEN_SOURCE 600
 #endif
+#ifndef _GNU_SOURCE /* memfd_create(), F_ADD_SEALS on GNU systems */
+#define _GNU_SOURCE 1
+#endif
 /* large file support needed for stat(),fstat() input file > 2 GB */
 #if defined(_AIX)
 #ifndef _LARGE_FILES
@@ -59,6 +62,9 @@
 #include <string.h>    /* memcpy(), strlen() */
 #include <stdio.h>     /* rename() */
 #include <unistd.h>    /* unlink() */
+#include <fcntl.h>     /* fcntl() F_ADD_SEALS */
+#include <sys/mman.h>  /* memfd_create() */
+#include <sys/socket.h>/* sendmsg() SCM_RIGHTS */
 
 int
 mcdb_makefn_start (struct mcdb_make * const restrict m,
@@ -129,7 +135,8 @@ mcdb_makefn_cleanup (struct mcdb_make * const restrict m)
 {
     const int errsave = errno;
     if (m->fd != -1) {                       /* (fd == -1 if mkstemp() fails) */
-        unlink(m->fntmp);
+        if (m->fntmp != NULL)                /* (NULL if memfd) */
+            unlink(m->fntmp);
         if (m->fd >= 0)
             (void) nointr_close(m->fd);
         m->fd = -1;
@@ -142,3 +149,92 @@ mcdb_makefn_cleanup (struct mcdb_make * const restrict m)
         errno = errsave;
     return -1;
 }
+
+
+/* mcdb in memory file (memfd) for publishing to other processes via fd
+ * (no filesystem; no fdatasync()).  mcdb_makefn_memfd_finish() seals memfd
+ * (read-only, fixed size) and returns fd, owned by caller, to pass to local
+ * processes (mcdb_makefn_memfd_send()); consumers mcdb_mmap_create_fd() */
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+
+int
+mcdb_makefn_memfd_start (struct mcdb_make * const restrict m,
+                         const char * const restrict name,
+                         void * (* const fn_malloc)(size_t),
+                         void (* const fn_free)(void *))
+{
+    m->head[0]   = NULL;
+    m->fntmp     = NULL;
+    m->fname     = name;
+    m->st_mode   = S_IRUSR;
+    m->fn_malloc = fn_malloc;
+    m->fn_free   = fn_free;
+    m->fd        = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    return m->fd != -1 ? EXIT_SUCCESS : -1;
+}
+
+int
+mcdb_makefn_memfd_finish (struct mcdb_make * const restrict m)
+{
+    /* (mcdb_make_finish() must have been called; write mmap is released) */
+    const int fd = m->fd;
+    if (fcntl(fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+        return -1;
+    m->fd = -1;  /* fd owned by caller */
+    return fd;
+}
+
+#else
+
+int
+mcdb_makefn_memfd_start (struct mcdb_make * const restrict m,
+                         const char * const restrict name
+                           __attribute_unused__,
+                         void * (* const fn_malloc)(size_t)
+                           __attribute_unused__,
+                         void (* const fn_free)(void *) __attribute_unused__)
+{
+    m->head[0] = NULL;
+    m->fntmp   = NULL;
+    m->fd      = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+mcdb_makefn_memfd_finish (struct mcdb_make * const restrict m
+                            __attribute_unused__)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+int
+mcdb_makefn_memfd_send (const int sock, const int fd)
+{
+    char c = 'm';
+    struct iovec iov = { &c, 1 };
+    union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } u;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t w;
+    memset(&msg, '\0', sizeof(msg));
+    memset(&u, '\0', sizeof(u));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    do {
+        w = sendmsg(sock, &msg, 0);
+    } while (w == -1 && errno == EINTR);
+    return w == 1 ? EXIT_SUCCESS : -1;
+}
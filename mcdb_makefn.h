@@ -48,6 +48,25 @@ int
 mcdb_makefn_cleanup (struct mcdb_make * restrict)
   __attribute_nonnull__;
 
+/* build mcdb in sealed memfd (Linux; else ENOSYS) instead of file:
+ *   mcdb_makefn_memfd_start(), mcdb_make_start(m, m->fd, ...), mcdb_make_add()
+ *   ..., mcdb_make_finish(), fd = mcdb_makefn_memfd_finish() (fd is read-only,
+ *   owned by caller), mcdb_makefn_cleanup() (always)
+ * mcdb_makefn_memfd_send() passes fd over UNIX domain socket (SCM_RIGHTS)
+ * (receiver: mcdb_mmap_fd_recv() and mcdb_mmap_create_fd()) */
+int
+mcdb_makefn_memfd_start (struct mcdb_make * restrict, const char * restrict,
+                         void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+int
+mcdb_makefn_memfd_finish (struct mcdb_make * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+int
+mcdb_makefn_memfd_send (int, int)
+  __attribute_warn_unused_result__;
+
 #ifdef __cplusplus
 }
 #endif
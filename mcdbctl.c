@@ -58,9 +58,9 @@
 #include <fcntl.h>   /* open(), O_RDONLY */
 #include <stdbool.h> /* bool */
 #include <stdio.h>   /* printf(), snprintf(), IOV_MAX */
-#include <stdlib.h>  /* malloc(), free(), EXIT_SUCCESS */
+#include <stdlib.h>  /* malloc(), free(), strtoul(), EXIT_SUCCESS */
 #include <string.h>  /* strlen() */
-#include <unistd.h>  /* STDIN_FILENO, STDOUT_FILENO _SC_PAGESIZE */
+#include <unistd.h>  /* STDIN_FILENO, STDOUT_FILENO _SC_PAGESIZE getopt() */
 #include <sys/uio.h> /* writev() */
 #include <libgen.h>  /* basename() */
 #include <limits.h>  /* SSIZE_MAX */
@@ -227,6 +227,71 @@ mcdbctl_dump(struct mcdb * const restrict m)
       : MCDB_ERROR_WRITE;
 }
 
+/* histogram of probe lengths of keys not in mcdb: each lvl2 hash table entry
+ * (each group if MCDB_FLAG_SWISS) as start of probe, count occupied entries
+ * (full groups) probed before empty entry (group with an empty entry) ends
+ * probe.  Returns total number of hash table entries.
+ * (MCDB_FLAG_MPH: no probe sequence; returns 0 and histogram is not updated)*/
+static unsigned long
+mcdbctl_stats_miss(const struct mcdb_mmap * const restrict map,
+                   unsigned long * const restrict numd)
+  __attribute_nonnull__;
+static unsigned long
+mcdbctl_stats_miss(const struct mcdb_mmap * const restrict map,
+                   unsigned long * const restrict numd)
+{
+    const bool swiss = (map->flags & MCDB_FLAG_SWISS);
+    const uint32_t b = map->b;
+    const uint32_t ne = mcdb_swiss_entries(b);
+    const uint32_t shift = swiss ? MCDB_SWISS_SHIFT : b;
+    const uint32_t doff = (b == 3) ? 4 : 8;  /* dpos offset in entry */
+    unsigned long total = 0;
+    const unsigned char *p;
+    uint32_t i, j, k, n, e, run;
+    if (map->flags & MCDB_FLAG_MPH)
+        return 0;
+    for (i = 0; i < (1u << map->slot_bits); ++i) {
+        p = map->ptr + map->slots + ((uintptr_t)i << 4);
+        n = uint32_strunpack_bigendian_aligned_macro(p+8); /* hslots */
+        if (n == 0)
+            continue;
+        p = map->ptr + (uintptr_t)uint64_strunpack_bigendian_aligned_macro(p);
+        total += swiss ? (unsigned long)n * ne : n;
+        /* find an empty entry (group) e, then walk backwards from e,
+         * counting run of occupied entries (full groups) preceding each */
+        for (e = 0; e < n; ++e) {
+            const unsigned char * const q = p + ((uintptr_t)e << shift);
+            if (swiss) {
+                for (k = 0; k < ne && q[k] != 0; ++k) ;
+                if (k < ne)
+                    break;
+            }
+            else if (b == 3
+                     ? uint32_strunpack_bigendian_aligned_macro(q+doff) == 0
+                     : uint64_strunpack_bigendian_aligned_macro(q+doff) == 0)
+                break;
+        }
+        if (e == n)   /*(should not happen; tables always have empty entry)*/
+            e = 0;
+        for (run = 0, j = e, k = 0; k < n; ++k, j = (j ? j : n) - 1) {
+            const unsigned char * const q = p + ((uintptr_t)j << shift);
+            bool empty;
+            if (swiss) {
+                uint32_t c;
+                for (c = 0; c < ne && q[c] != 0; ++c) ;
+                empty = (c < ne);
+            }
+            else
+                empty = (b == 3)
+                  ? uint32_strunpack_bigendian_aligned_macro(q+doff) == 0
+                  : uint64_strunpack_bigendian_aligned_macro(q+doff) == 0;
+            run = empty ? 0 : run + 1;
+            ++numd[ (run < 10) ? run : 10 ];
+        }
+    }
+    return total;
+}
+
 /* Note: mcdbctl_stats() is equivalent test to pass/fail of djb cdbtest */
 static int
 mcdbctl_stats(struct mcdb * const restrict m)
@@ -241,6 +306,8 @@ mcdbctl_stats(struct mcdb * const restrict m)
                                              MCDB_HEADER_SZ);
     unsigned long nrec = 0;
     unsigned long numd[11] = { 0,0,0,0,0,0,0,0,0,0,0 };
+    unsigned long numm[11] = { 0,0,0,0,0,0,0,0,0,0,0 };
+    unsigned long nslots;
     int rv;
     bool rc;
     posix_madvise(m->map->ptr, m->map->size,
@@ -268,6 +335,16 @@ mcdbctl_stats(struct mcdb * const restrict m)
     for (rv = 0; rv < 10; ++rv)
         printf("d%d      %lu\n", rv, numd[rv]);
     printf(">9      %lu\n", numd[10]);
+    /* lvl2 hash table size and probe lengths of keys not in mcdb */
+    nslots = mcdbctl_stats_miss(m->map, numm);
+    if (nslots != 0) {
+        printf("hslots  %lu (load %lu%%)\n", nslots, nrec * 100 / nslots);
+        for (rv = 0; rv < 10; ++rv)
+            printf("m%d      %lu\n", rv, numm[rv]);
+        printf("m>9     %lu\n", numm[10]);
+    }
+    if (m->map->gen != 0)
+        printf("gen     %llu\n", (unsigned long long)m->map->gen);
     fflush(stdout);
     return EXIT_SUCCESS;
 }
@@ -401,22 +478,108 @@ mcdbctl_query(const int argc, char ** restrict argv)
 }
 
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv)
+mcdbctl_make(const int argc, char ** const restrict argv)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv)
+mcdbctl_make(const int argc, char ** const restrict argv)
 {
-    /* assert(argc == 4); */                   /* must be checked by caller */
+    /* assert(argc >= 4); */                   /* must be checked by caller */
     /* assert(0 == strcmp(argv[1], "make")); *//* must be checked by caller */
     enum { BUFSZ = 65536 }; /* 64 KB buffer size */
     char * restrict buf = NULL;
-    char * const fname = argv[2];
-    char * const input = argv[3];
-    const int rv = (input[0] == '-' && input[1] == '\0')
+    char *fname;
+    char *input;
+    char *e;
+    struct mcdb_make_opts opts =
+      { MCDB_HASH_DJB, 0, MCDB_FLAGS_NONE, 0, 0, 0, 0, 0,
+        MCDB_MAKE_INPUT_CDB };
+    int rv;
+    int c;
+
+    /* parse options following "make" (argv[1] treated as argv[0] by getopt) */
+    while ((c = getopt(argc-1, argv+1, "B:G:H:I:L:S:j:Rmsw")) != -1) {
+        switch (c) {
+          case 'B': /* lvl1 slot bits (8 - 16) */
+            opts.slot_bits = (uint32_t)strtoul(optarg, &e, 10);
+            if (*optarg == '\0' || *e != '\0'
+                || opts.slot_bits < MCDB_SLOT_BITS
+                || opts.slot_bits > MCDB_SLOT_BITS_MAX)
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'G': /* mcdb generation stored in header */
+            opts.gen = (uint64_t)strtoull(optarg, &e, 0);
+            if (*optarg == '\0' || *e != '\0')
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'H':
+            if (0 == strcmp(optarg, "djb"))
+                opts.hash_id = MCDB_HASH_DJB;
+            else if (0 == strcmp(optarg, "crc32c"))
+                opts.hash_id = MCDB_HASH_CRC32C;
+            else if (0 == strcmp(optarg, "mix"))
+                opts.hash_id = MCDB_HASH_MIX;
+            else
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'I': /* input format */
+            if (0 == strcmp(optarg, "cdb"))
+                opts.input = MCDB_MAKE_INPUT_CDB;
+            else if (0 == strcmp(optarg, "le32"))
+                opts.input = MCDB_MAKE_INPUT_BIN_LE;
+            else if (0 == strcmp(optarg, "be32"))
+                opts.input = MCDB_MAKE_INPUT_BIN_BE;
+            else if (0 == strcmp(optarg, "le32+hash"))
+                opts.input = MCDB_MAKE_INPUT_BIN_LE | MCDB_MAKE_INPUT_BIN_HASH;
+            else if (0 == strcmp(optarg, "be32+hash"))
+                opts.input = MCDB_MAKE_INPUT_BIN_BE | MCDB_MAKE_INPUT_BIN_HASH;
+            else
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'S':
+            opts.hash_seed = (uint32_t)strtoul(optarg, &e, 0);
+            if (*optarg == '\0' || *e != '\0')
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'j': /* threads parsing input, filling hash tables (1 - 64) */
+            opts.threads = (uint32_t)strtoul(optarg, &e, 10);
+            if (*optarg == '\0' || *e != '\0'
+                || opts.threads < 1 || opts.threads > 64)
+                return MCDB_ERROR_USAGE;
+            break;
+          case 'R': /* Robin Hood hash table insertion */
+            opts.insert = MCDB_MAKE_INSERT_ROBINHOOD;
+            break;
+          case 'm': /* minimal perfect hash index (keys must be unique) */
+            opts.flags |= MCDB_FLAG_MPH;
+            break;
+          case 's': /* cache-line groups (Swiss-style) hash table layout */
+            opts.flags |= MCDB_FLAG_SWISS;
+            break;
+          case 'w': /* wide hash entries w/ klen and key fingerprint */
+            opts.flags |= MCDB_FLAG_KEYFP;
+            break;
+          case 'L': /* lvl2 hash table entries per 100 records (125 - 400) */
+            opts.hslots_pct = (uint32_t)strtoul(optarg, &e, 10);
+            if (*optarg == '\0' || *e != '\0'
+                || opts.hslots_pct < MCDB_MAKE_HSLOTS_PCT_MIN
+                || opts.hslots_pct > MCDB_MAKE_HSLOTS_PCT_MAX)
+                return MCDB_ERROR_USAGE;
+            break;
+          default:
+            return MCDB_ERROR_USAGE;
+        }
+    }
+    if (argc-1 - optind != 2)
+        return MCDB_ERROR_USAGE;
+    fname = argv[1+optind];
+    input = argv[2+optind];
+
+    rv = (input[0] == '-' && input[1] == '\0')
       ? ((buf = malloc(BUFSZ)) != NULL)
-        ? mcdb_makefmt_fdintofile(STDIN_FILENO, buf, BUFSZ, fname, malloc, free)
+        ? mcdb_makefmt_fdintofile_opts(STDIN_FILENO, buf, BUFSZ, fname,
+                                       malloc, free, &opts)
         : MCDB_ERROR_MALLOC
-      : mcdb_makefmt_fileintofile(input, fname, malloc, free);
+      : mcdb_makefmt_fileintofile_opts(input, fname, malloc, free, &opts);
     free(buf);
     return rv;
 }
@@ -465,12 +628,16 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
                                              MCDB_HEADER_SZ);
     uint32_t dlen;
     int rv = EXIT_SUCCESS;
+    const struct mcdb_make_opts opts =
+      { m->map->hash_id, m->map->hash_init, m->map->flags, 0, 0,
+        m->map->slot_bits, m->map->gen, 0, MCDB_MAKE_INPUT_CDB };
     posix_madvise(m->map->ptr, m->map->size,
                   POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
     if (!mcdb_validate_slots(m))
         return MCDB_ERROR_READFORMAT;
     if (mcdb_makefn_start(&mk, m->map->fname, malloc, free) == 0
-        && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+        && mcdb_make_start(&mk, mk.fd, malloc, free) == 0
+        && mcdb_make_setopts(&mk, &opts) == 0) { /*(preserve hash, flags)*/
         mcdb_iter_init(&iter, m);
         while (mcdb_iter(&iter) && rv == EXIT_SUCCESS) {
             /* Technically, passing m (which contains m->map->ptr) and an
@@ -549,7 +716,10 @@ mcdbctl_uniq(const int argc, char ** const restrict argv)
 }
 
 static const char * const restrict mcdb_usage =
-   "mcdbctl make  <fname.mcdb> <datafile|->\n"
+   "mcdbctl make  [-H djb|crc32c|mix] [-S seed] [-B 8-16] [-L 125-400]\n"
+   "                       [-G gen] [-j threads] [-R] [-m|-s|-w]\n"
+   "                       [-I cdb|le32|be32|le32+hash|be32+hash]\n"
+   "                       <fname.mcdb> <datafile|->\n"
    "         mcdbctl uniq  <fname.mcdb> [\"first\"|\"last\"]\n"
    "         mcdbctl dump  <fname.mcdb>\n"
    "         mcdbctl stats <fname.mcdb>\n"
@@ -559,7 +729,8 @@ static const char * const restrict mcdb_usage =
  * mcdbctl get   <mcdb> <key> [seq]
  * mcdbctl dump  <mcdb>
  * mcdbctl stats <mcdb>
- * mcdbctl make  <mcdb> <input-file>
+ * mcdbctl make  [-H hash] [-S seed] [-B bits] [-L pct] [-G gen] [-j threads]
+ *               [-R] [-m|-s|-w] [-I input-format] <mcdb> <input-file>
  * mcdbctl uniq  <mcdb> ["first"|"last"]
  *
  * mcdbctl tools require mcdb filename be specified on the command line.
@@ -569,7 +740,7 @@ int
 main(int argc, char ** const restrict argv)
 {
     int rv;
-    if (argc == 4 && 0 == strcmp(argv[1], "make"))
+    if (argc >= 4 && 0 == strcmp(argv[1], "make"))
         rv = mcdbctl_make(argc, argv);
     else if ((argc == 3 || argc == 4) && 0 == strcmp(argv[1], "uniq"))
         rv = mcdbctl_uniq(argc, argv);
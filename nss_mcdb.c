@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -38,6 +39,10 @@
 #define pthread_mutex_unlock(mutexp) (void)0
 #endif
 
+#ifndef O_CLOEXEC /* O_CLOEXEC available since Linux 2.6.23 */
+#define O_CLOEXEC 0
+#endif
+
 /*
  * man nsswitch.conf
  *     /etc/nsswitch.conf
@@ -61,13 +66,6 @@
  * (and -would not- use the static storage (e.g. no use of _nss_mcdb_mmap_st[]))
  */
 
-/* compile-time setting for security
- * /etc/mcdb/ is recommended so that .mcdb are on same partition as flat files
- * (implies that if flat files visible, then likely so are .mcdb equivalents) */
-#ifndef NSS_MCDB_DBPATH
-#define NSS_MCDB_DBPATH "/etc/mcdb/"
-#endif
-
 /* NOTE: path to db must match up to enum nss_dbtype index
  * (static two-dimensional array instead of ptrs to reduce num DSO relocations)
  * (+14 for longest name, e.g. "protocols.mcdb") */
@@ -97,6 +95,34 @@ static struct mcdb_mmap *_nss_mcdb_mmap[_nss_num_dbs];
 
 static __thread struct mcdb _nss_mcdb_st[_nss_num_dbs];
 
+/* generation word in shared file NSS_MCDB_GENERATION (nss_mcdb.h),
+ * incremented by nss_mcdbctl after updating any mcdb in NSS_MCDB_DBPATH.
+ * mcdb stat() check is skipped while generation is unchanged (plain load from
+ * shared mapping instead of stat() every query).
+ * (mcdb stat() is checked every query if generation file does not exist)
+ * (generation file must be updated in place; not replaced) */
+
+static const volatile uint32_t *_nss_mcdb_generation;
+static uint32_t _nss_mcdb_generation_seen[_nss_num_dbs];
+
+static void
+_nss_mcdb_generation_map(void)
+  __attribute_cold__;
+static void
+_nss_mcdb_generation_map(void)
+{
+    struct stat st;
+    void *x;
+    const int fd = open(NSS_MCDB_GENERATION, O_RDONLY|O_NONBLOCK|O_CLOEXEC, 0);
+    if (fd == -1)
+        return;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(uint32_t)
+        && (x = mmap(0, sizeof(uint32_t), PROT_READ, MAP_SHARED, fd, 0))
+             != MAP_FAILED)
+        _nss_mcdb_generation = (const volatile uint32_t *)x;
+    (void) close(fd); /* close fd once it has been mmap'ed */
+}
+
 #ifdef _FORTIFY_SOURCE
 static void _nss_mcdb_atexit(void)
 {
@@ -142,6 +168,15 @@ _nss_mcdb_db_openshared(const enum nss_dbtype dbtype)
         return true;
     }
 
+    {   static bool generation_once = true;
+        if (generation_once) {
+            generation_once = false;
+            _nss_mcdb_generation_map();
+        }
+        /* (read generation prior to opening mcdb) */
+        if (_nss_mcdb_generation != NULL)
+            _nss_mcdb_generation_seen[dbtype] = *_nss_mcdb_generation;   }
+
   #ifdef _FORTIFY_SOURCE
     {   static bool atexit_once = true;
         if (atexit_once) { atexit_once = false; atexit(_nss_mcdb_atexit); }   }
@@ -176,12 +211,10 @@ static bool _nss_mcdb_stayopen = true;
 
 /* get shared mcdb_mmap */
 static struct mcdb_mmap *  __attribute_regparm__((2))
-_nss_mcdb_db_getshared(const enum nss_dbtype dbtype,
-                       const int mcdb_flags)
+_nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
   __attribute_warn_unused_result__;
 static struct mcdb_mmap *  __attribute_regparm__((2))
-_nss_mcdb_db_getshared(const enum nss_dbtype dbtype,
-                       const int mcdb_flags)
+_nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
 {
     /* reuse set*ent(),get*ent(),end*end() session if open in current thread */
     if (_nss_mcdb_st[dbtype].map != NULL)
@@ -198,9 +231,19 @@ _nss_mcdb_db_getshared(const enum nss_dbtype dbtype,
           case NSS_DBTYPE_RPC:
           case NSS_DBTYPE_SERVICES: if (_nss_mcdb_stayopen) break;
           default:
+            if (_nss_mcdb_generation != NULL) {
+                const uint32_t gen = *_nss_mcdb_generation;
+                if (__builtin_expect(gen==_nss_mcdb_generation_seen[dbtype],1))
+                    break;
+                /* (update seen generation unless refresh failed; retry) */
+                if (!mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype])
+                    || mcdb_mmap_reopen_threadsafe_h(&_nss_mcdb_mmap[dbtype]))
+                    _nss_mcdb_generation_seen[dbtype] = gen;
+                break;
+            }
             /*(void)mcdb_mmap_refresh_threadsafe(&_nss_mcdb_mmap[dbtype]);*/
             (void)(__builtin_expect(
-               mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]), true)
+               !mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]), true)
                ||  __builtin_expect(
                mcdb_mmap_reopen_threadsafe_h(&_nss_mcdb_mmap[dbtype]), true));
             break;
@@ -209,9 +252,8 @@ _nss_mcdb_db_getshared(const enum nss_dbtype dbtype,
     else if (!_nss_mcdb_db_openshared(dbtype))
         return NULL;
 
-    return mcdb_mmap_thread_registration_h(&_nss_mcdb_mmap[dbtype], mcdb_flags)
-      ? _nss_mcdb_mmap[dbtype]
-      : NULL;  /* (fails if obtaining mutex fails, i.e. EAGAIN) */
+    /* register use of shared mcdb_mmap (lock-free) */
+    return mcdb_mmap_thread_register_shared_h(&_nss_mcdb_mmap[dbtype]);
 }
 
 INTERNAL nss_status_t  __attribute_noinline__ /*(skip _nss_mcdb_getent inline)*/
@@ -219,9 +261,8 @@ nss_mcdb_setent(const enum nss_dbtype dbtype,
                 const int stayopen  __attribute_unused__)
 {
     struct mcdb * const restrict m = &_nss_mcdb_st[dbtype];
-    const int mcdb_flags = MCDB_REGISTER_USE_INCR;
     if (m->map != NULL
-        || (m->map = _nss_mcdb_db_getshared(dbtype, mcdb_flags)) != NULL) {
+        || (m->map = _nss_mcdb_db_getshared(dbtype)) != NULL) {
         m->hpos = (uintptr_t)(m->map->ptr + MCDB_HEADER_SZ);
         return NSS_STATUS_SUCCESS;
     }
@@ -317,14 +358,11 @@ nss_mcdb_get_generic(const enum nss_dbtype dbtype,
 {
     struct mcdb m;
     nss_status_t status;
-    const int mcdb_flags_lock =
-      MCDB_REGISTER_USE_INCR | MCDB_REGISTER_MUTEX_LOCK_HOLD;
 
-    /* Queries to mcdb are quick, so attempt to reduce locking overhead.
-     * Set mcdb_flags to get and release mcdb_global_mutex once instead of
-     * grab/release mutex to register, then grab/release mutex to unregister */
+    /* Queries to mcdb are quick; registering and unregistering use of shared
+     * mcdb_mmap does not take mcdb_global_mutex unless mcdb_mmap is replaced*/
 
-    m.map = _nss_mcdb_db_getshared(dbtype, mcdb_flags_lock);
+    m.map = _nss_mcdb_db_getshared(dbtype);
     if (__builtin_expect(m.map == NULL, false)) {
         *v->errnop = errno;
         return NSS_STATUS_UNAVAIL;
@@ -340,11 +378,9 @@ nss_mcdb_get_generic(const enum nss_dbtype dbtype,
 
     /* set*ent(),get*ent(),end*end() session not open/reused in current thread*/
     if (_nss_mcdb_st[dbtype].map == NULL) {
-        const int mcdb_flags_unlock =
-            MCDB_REGISTER_USE_DECR
-          | MCDB_REGISTER_MUNMAP_SKIP
-          | MCDB_REGISTER_MUTEX_UNLOCK_HOLD;
-        _nss_mcdb_db_relshared(m.map, mcdb_flags_unlock);
+        const int mcdb_flags =
+            MCDB_REGISTER_USE_DECR | MCDB_REGISTER_MUNMAP_SKIP;
+        _nss_mcdb_db_relshared(m.map, mcdb_flags);
     }
 
     return status;
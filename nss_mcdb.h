@@ -70,6 +70,18 @@
   } nss_status_t;
 #endif
 
+/* compile-time setting for security
+ * /etc/mcdb/ is recommended so that .mcdb are on same partition as flat files
+ * (implies that if flat files visible, then likely so are .mcdb equivalents) */
+#ifndef NSS_MCDB_DBPATH
+#define NSS_MCDB_DBPATH "/etc/mcdb/"
+#endif
+
+/* generation file (libnss_mcdb detects updated mcdb; nss_mcdbctl updates) */
+#ifndef NSS_MCDB_GENERATION
+#define NSS_MCDB_GENERATION NSS_MCDB_DBPATH".generation"
+#endif
+
 /* enum nss_dbtype index must match path in nss_mcdb.c char *_nss_dbnames[] */
 enum nss_dbtype {
     NSS_DBTYPE_ALIASES = 0,  /* first enum element here must always be 0 */
@@ -59,17 +59,43 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>  /* stat(), fchmod(), umask() */
+#include <sys/mman.h>  /* mmap() munmap() */
+#include <fcntl.h>     /* open() */
 #include <limits.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>    /* malloc() free() */
 #include <stdio.h>     /* rename() */
 #include <string.h>    /* memcpy() strlen() */
-#include <unistd.h>    /* sysconf() unlink() */
+#include <unistd.h>    /* sysconf() unlink() ftruncate() close() */
 
 /* Note: blank line is required to denote end of mcdb input 
  * Ensure blank line is written after w.wbuf is flushed. */
 
+/* increment generation word read by libnss_mcdb to detect updated mcdb
+ * (updated in place via shared mapping; file must not be replaced) */
+static bool
+nss_mcdbctl_generation_incr(void)
+{
+    struct stat st;
+    void *x;
+    bool rc = false;
+    const int fd = open(NSS_MCDB_GENERATION,
+                        O_RDWR|O_CREAT|O_NONBLOCK|O_CLOEXEC,
+                        S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+    if (fd == -1)
+        return false;
+    if (fstat(fd, &st) == 0
+        && (st.st_size >= (off_t)sizeof(uint32_t)
+            || ftruncate(fd, (off_t)sizeof(uint32_t)) == 0)
+        && (x = mmap(0, sizeof(uint32_t), PROT_READ|PROT_WRITE, MAP_SHARED,
+                     fd, 0)) != MAP_FAILED) {
+        __sync_fetch_and_add((uint32_t *)x, 1);
+        rc = (munmap(x, sizeof(uint32_t)) == 0);
+    }
+    return (close(fd) == 0) && rc;
+}
+
 int main(void)
 {
     /* WBUFSZ must be >= ((largest record possible * 2) + 26) */
@@ -169,6 +195,7 @@ int main(void)
     const time_t mtime_nsswitch =
       (stat("/etc/nsswitch.conf", &st) == 0) ? st.st_mtime : 0;
     bool rc = false;
+    bool updated = false;
 
     if (wbuf->buf == NULL || w.data == NULL) {
         free(w.data);
@@ -234,8 +261,13 @@ int main(void)
         mcdb_makefn_cleanup(wbuf->m);
         if (!rc)
             break;
+        updated = true;
     }
 
+    /* notify libnss_mcdb of updated mcdb (even if subsequent mcdb failed) */
+    if (updated && !nss_mcdbctl_generation_incr())
+        rc = false;
+
     free(w.data);
     free(wbuf->buf);
 
@@ -230,6 +230,310 @@ echo '--- mcdbstats handles random.mcdb'
 mcdbstats random.mcdb >/dev/null
 rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbmake handles built-in hash functions'
+for h in crc32c mix; do
+  mcdbctl make -H $h -S 12345 random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb > random.dump
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp ../random.in random.dump >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:one->Goodbye
++28,3:a key longer than sixteen...->two
+' | mcdbctl make -H $h rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 1 >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 2 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb 'a key longer than sixteen...' >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+echo '' | mcdbctl make -H nosuchhash test.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake handles wide hash entries (key fingerprint)'
+for h in djb mix; do
+  mcdbctl make -w -H $h random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:one->Goodbye
++3,5:two->Hello
+' | mcdbctl make -w -H $h rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 1 >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 2 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb three >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+
+echo '--- mcdbmake handles cache-line group hash table layout'
+for h in djb mix; do
+  mcdbctl make -s -H $h random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:one->Goodbye
++3,5:two->Hello
+' | mcdbctl make -s -H $h rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 1 >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb one 2 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  mcdbget rep.mcdb three >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make -s -m rep.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake handles hash table size'
+for l in 125 150 400; do
+  mcdbctl make -L $l random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl stats random.mcdb | grep '^hslots ' >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make -L 100 random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -L 150 -m random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake handles Robin Hood hash table insertion'
+for f in '' -w; do
+  mcdbctl make -R -L 125 $f random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:one->Goodbye
++3,5:one->Again
++3,5:two->Hello
+' | mcdbctl make -R $f rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "`mcdbget rep.mcdb one 1`" = "Goodbye" ] || echo 1>&2 "FAIL"
+  [ "`mcdbget rep.mcdb one 2`" = "Again" ] || echo 1>&2 "FAIL"
+  mcdbget rep.mcdb three >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make -R -m random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake handles multi-threaded hash table construction'
+for f in '' -R -s -w; do
+  mcdbctl make $f random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make -j 4 $f random.j.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.mcdb random.j.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.j.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+rm -f random.j.mcdb
+
+echo '--- mcdbmake handles multi-threaded input parsing'
+{ sed '$d' ../random.in; sed '$d' ../random.in; cat ../random.in; } > random3.in
+for f in '' -R -s; do
+  mcdbctl make $f random.mcdb - < random3.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make -j 4 $f random.j.mcdb random3.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.mcdb random.j.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+sed '$d' random3.in > random3.bad.in
+mcdbctl make -j 4 random.j.mcdb random3.bad.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f random.j.mcdb random3.in random3.bad.in
+
+echo '--- mcdbmake handles binary input'
+mcdbctl make random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+for f in le32 be32 le32+hash be32+hash; do
+  perl -e '$/=undef; $_=<STDIN>; $p=0; $f=shift; $n=($f=~/^le/)?"V":"N";
+    while (substr($_,$p,1) eq "+") {
+      /\G\+(\d+),(\d+):/gc or last; ($k,$d)=($1,$2); $p=pos;
+      $key=substr($_,$p,$k); $data=substr($_,$p+$k+2,$d); $p+=$k+$d+3; pos=$p;
+      $h=5381; $h=((($h<<5)+$h)^ord($_))&0xffffffff for split //,$key;
+      print pack($n.$n,$k,$d), ($f=~/hash/ ? pack($n,$h) : ""), $key, $data;
+    }' $f < ../random.in > random.bin
+  mcdbctl make -I $f random.b.mcdb - < random.bin
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.mcdb random.b.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make -I $f random.b.mcdb random.bin
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.mcdb random.b.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+head -c 100 random.bin | mcdbctl make -I $f random.b.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f random.b.mcdb random.bin
+
+echo '--- mcdbmake handles lvl1 slot bits'
+for f in '-B 9' '-B 12 -R' '-B 16 -w'; do
+  mcdbctl make $f random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:one->Goodbye
++3,5:two->Hello
+' | mcdbctl make $f rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "`mcdbget rep.mcdb one 1`" = "Goodbye" ] || echo 1>&2 "FAIL"
+  mcdbctl uniq rep.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "`mcdbget rep.mcdb one`" = "Hello" ] || echo 1>&2 "FAIL"
+  mcdbget rep.mcdb one 1 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make -B 17 random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -B 12 -m random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake stores generation in header'
+echo '+3,5:one->Hello
+' | mcdbctl make -G 0x123456789 gen.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbstats gen.mcdb | grep -q '^gen     4886718345$' || echo 1>&2 "FAIL"
+mcdbctl uniq gen.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbstats gen.mcdb | grep -q '^gen     4886718345$' || echo 1>&2 "FAIL"
+mcdbctl make -G 12x gen.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake handles perfect hash index'
+for h in djb crc32c; do
+  mcdbctl make -m -H $h random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  echo '+3,5:one->Hello
++3,7:two->Goodbye
+' | mcdbctl make -m -H $h test.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget test.mcdb two >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbget test.mcdb one 1 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  mcdbget test.mcdb three >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+echo '+3,5:one->Hello
++3,7:one->Goodbye
+' | mcdbctl make -m rep.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- testmcdbrand mcdb_findmany() matches mcdb_find()'
+for f in '' -w -s -R '-B 12' -m; do
+  mcdbctl make $f random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  testmcdbrand -c random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$f" = -m ] && continue
+  { sed '$d' ../random.in; cat ../random.in; } | mcdbctl make $f rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  testmcdbrand -c rep.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+
+echo '--- testmcdbrand non-blocking lookup matches mcdb_find()'
+for f in '' -w -s -R '-B 12' -m '-H crc32c' '-H mix'; do
+  mcdbctl make $f random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  testmcdbrand -t random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$f" = -m ] && continue
+  { sed '$d' ../random.in; cat ../random.in; } | mcdbctl make $f rep.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  testmcdbrand -t rep.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+
+echo '--- mcdbstats handles v2 header and legacy (v1) header'
+mcdbmake random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '\377' | dd of=random.mcdb bs=1 seek=111 conv=notrunc 2>/dev/null
+mcdbtest random.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+printf '\0\0\0\0' | dd of=random.mcdb bs=1 seek=44 conv=notrunc 2>/dev/null
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb | cmp ../random.in - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- testmcdbmake handles multiple producer shards'
+testmcdbmake shard.mcdb 100000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmake shard.j.mcdb 100000 4
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp shard.mcdb shard.j.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest shard.j.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbget shard.j.mcdb 00099999`" = "00099999" ] || echo 1>&2 "FAIL"
+rm -f shard.mcdb shard.j.mcdb
+
+echo '--- testmcdbmake publishes mcdb in memfd over UNIX socket'
+testmcdbmake -m 1000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- testmcdbmmap registers threads while mcdb is reopened'
+testmcdbmake mmap.mcdb 1000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmmap -r mmap.mcdb 8
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- testmcdbmmap handles mcdb_mmap cache'
+for f in a b c; do
+  testmcdbmake cache.$f.mcdb 100
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+testmcdbmake cache.big.mcdb 10000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmmap -c cache.a.mcdb cache.b.mcdb cache.c.mcdb cache.big.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f cache.a.mcdb cache.b.mcdb cache.c.mcdb cache.big.mcdb
+
+echo '--- testmcdbmmap handles hot page record/replay'
+testmcdbmmap -h mmap.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ -f mmap.mcdb.hot ] || echo 1>&2 "FAIL"
+rm -f mmap.mcdb mmap.mcdb.hot
+
+echo '--- testmcdbmmap lookup across reopen to mcdb of different hash'
+mcdbctl make rehash.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -H crc32c -S 12345 rehash.a.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -H mix rehash.b.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmmap -x rehash.mcdb rehash.a.mcdb rehash.b.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f rehash.mcdb rehash.a.mcdb rehash.b.mcdb
 
 echo '--- testzero works'
 testzero 5 test.mcdb
@@ -21,30 +21,161 @@
 
 #include "mcdb.h"
 #include "mcdb_make.h"
+#include "mcdb_makefn.h"
 #include "mcdb_error.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>/* socketpair() */
+#include <errno.h>
 #include <fcntl.h>     /* open() */
 #include <stdio.h>     /* snprintf() */
 #include <stdlib.h>    /* malloc(), free(), strtoul() */
-#include <string.h>    /* memset() */
+#include <string.h>    /* memset() strcmp() */
 #include <unistd.h>    /* close() */
 
+#ifdef _THREAD_SAFE
+
+#include <pthread.h>
+
+/* records [u, e) generated by one thread and stored in its mcdb_make_shard */
+struct testmcdbmake_part {
+  struct mcdb_make_shard *shard;
+  unsigned long u;
+  unsigned long e;
+  pthread_t thread;
+  int created;
+};
+
+static void *
+testmcdbmake_part_thread (void * const arg)
+{
+    struct testmcdbmake_part * const part = arg;
+    char buf[21];  /*(20 digits for 64-bit unsigned long, plus '\0')*/
+    while (part->u < part->e) {
+        snprintf(buf, sizeof(buf), "%08lu", part->u);        /*generate record*/
+        if (0 != mcdb_make_shard_add(part->shard,buf,8,buf,8))  /*store record*/
+            break;
+        ++part->u;
+    }
+    return NULL;
+}
+
+/* generate records on n threads; mcdb is same as that generated serially */
+static unsigned long
+testmcdbmake_parts (struct mcdb_make * const m, const unsigned long e,
+                    unsigned long n)
+{
+    struct testmcdbmake_part part[64];
+    unsigned long u = 0;
+    unsigned long i;
+    if (n > sizeof(part)/sizeof(*part)) n = sizeof(part)/sizeof(*part);
+    for (i = 0; i < n; ++i) {
+        part[i].u = e / n * i;
+        part[i].e = (i + 1 < n) ? e / n * (i + 1) : e;
+        if ((part[i].shard = mcdb_make_shard_create(m)) == NULL) return 0;
+    }
+    for (i = 0; i < n; ++i)
+        part[i].created = (0 == pthread_create(&part[i].thread, NULL,
+                                               testmcdbmake_part_thread,
+                                               part+i));
+    for (i = 0; i < n; ++i) {
+        if (part[i].created)
+            pthread_join(part[i].thread, NULL);
+        else
+            testmcdbmake_part_thread(part+i);
+    }
+    for (i = 0; i < n; ++i)
+        u += part[i].u - (e / n * i);
+    return u;
+}
+
+#endif
+
+/* build mcdb of e records in sealed memfd, pass fd over UNIX socket, and
+ * mcdb_mmap_create_fd() from received fd; then build mcdb of e+1 records
+ * and pass it to mcdb_mmap_reinit_threadsafe().  Last key must be found. */
+static int
+testmcdbmake_memfd (const unsigned long e)
+{
+    struct mcdb_make mk;
+    struct mcdb m;
+    struct mcdb_mmap *map = NULL;
+    char buf[16];
+    unsigned long u, n;
+    int sv[2], fd, rc = 0;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        return mcdb_error(MCDB_ERROR_WRITE, "testmake", "socketpair");
+    for (n = e; n <= e+1 && rc == 0; ++n) {
+        fd = -1;
+        if (mcdb_makefn_memfd_start(&mk, "testmcdbmake", malloc, free) == 0
+            && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+            for (u = 0; u < n; ++u) {
+                snprintf(buf, sizeof(buf), "%08lu", u);      /*generate record*/
+                if (0 != mcdb_make_add(&mk,buf,8,buf,8))        /*store record*/
+                    break;
+            }
+            if (u == n && mcdb_make_finish(&mk) == 0)
+                fd = mcdb_makefn_memfd_finish(&mk);
+        }
+        mcdb_makefn_cleanup(&mk);
+        if (fd == -1) {
+            if (errno == ENOSYS)
+                break;  /* (memfd not supported; nothing to test) */
+            rc = mcdb_error(MCDB_ERROR_WRITE, "testmake", "memfd");
+            break;
+        }
+        rc = mcdb_makefn_memfd_send(sv[0], fd);
+        (void)close(fd);
+        if (rc != 0 || (fd = mcdb_mmap_fd_recv(sv[1])) == -1) {
+            rc = mcdb_error(MCDB_ERROR_READ, "testmake", "memfd send/recv");
+            break;
+        }
+        if (map == NULL)
+            map = mcdb_mmap_create_fd(NULL, fd, malloc, free, 0);
+        else if (!mcdb_mmap_reinit_threadsafe(&map, fd))
+            rc = -1;
+        (void)close(fd);
+        memset(&m, '\0', sizeof(m));
+        if (rc != 0 || map == NULL
+            || (m.map = mcdb_mmap_thread_register_shared(&map)) == NULL) {
+            rc = mcdb_error(MCDB_ERROR_READ, "testmake", "memfd mcdb");
+            break;
+        }
+        snprintf(buf, sizeof(buf), "%08lu", n-1);
+        if ((n != 0 && !mcdb_find(&m, buf, 8)) || mcdb_numrecs(&m) != n)
+            rc = mcdb_error(MCDB_ERROR_READ, "testmake", "memfd mcdb find");
+        (void)mcdb_thread_unregister(&m);
+    }
+    mcdb_mmap_destroy(map);
+    (void)close(sv[0]);
+    (void)close(sv[1]);
+    return rc;
+}
+
 int
 main (int argc, char **argv)
 {
     char buf[16];
     unsigned long u = 0;
     unsigned long e;
+    unsigned long n = 1;
     struct mcdb_make m;
     int fd;
     if (argc < 3) return -1;
     e = strtoul(argv[2], NULL, 10);
     if (e > 100000000u) return -1;  /*(only 8 decimal chars below; can change)*/
+    if (0 == strcmp(argv[1], "-m"))  /* testmcdbmake -m nrecs (memfd) */
+        return testmcdbmake_memfd(e);
+    if (argc > 3) n = strtoul(argv[3], NULL, 10); /* num threads (shards) */
     unlink(argv[1]);   /* unlink for repeatable test; ignore error if missing */
     if ((fd = open(argv[1],O_RDWR|O_CREAT,0666)) != -1
         && mcdb_make_start(&m,fd,malloc,free) == 0) {
+      #ifdef _THREAD_SAFE
+        if (n > 1 && e != 0)
+            u = testmcdbmake_parts(&m, e, n);
+        else
+      #endif
         /* generate and store records (generate 8-byte key and use as value)  */
         do { snprintf(buf, sizeof(buf), "%08lu", u);         /*generate record*/
         } while (0 == mcdb_make_add(&m,buf,8,buf,8) && ++u < e);/*store record*/
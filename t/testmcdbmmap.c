@@ -0,0 +1,353 @@
+/*
+ * testmcdbmmap - test for mcdb_mmap: thread registration vs reopen, cache,
+ *                hot page record/replay, lookup across reopen
+ *
+ * Copyright (c) 2011, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mcdb.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>  /* stat() */
+#include <errno.h>
+#include <stdio.h>     /* fprintf(), perror(), rename() */
+#include <stdlib.h>    /* malloc(), free(), strtoul() */
+#include <string.h>    /* memset() memcpy() strlen() */
+#include <unistd.h>    /* sysconf() link() */
+
+#ifdef _THREAD_SAFE
+
+#include <pthread.h>
+
+#define TESTMCDBMMAP_HOLD 20  /* registrations held per thread (> MCDB_PINS) */
+
+/* thread registering use of shared mcdb_mmap while it is being reopened */
+struct testmcdbmmap_reg {
+  struct mcdb_mmap **mapptr;
+  unsigned long n;
+  int rc;
+  pthread_t thread;
+};
+
+static void *
+testmcdbmmap_reg_thread (void * const arg)
+{
+    struct testmcdbmmap_reg * const reg = arg;
+    struct mcdb m[TESTMCDBMMAP_HOLD];
+    struct mcdb_iter iter;
+    unsigned long n;
+    unsigned int i = 0;
+    memset(m, '\0', sizeof(m));
+    reg->rc = -1;
+    for (n = 0; n < reg->n; ++n) {
+        /* hold registrations on successive mcdb_mmap, more than can be
+         * pinned by thread, and release oldest registration */
+        if (m[i].map != NULL) {
+            if (!mcdb_thread_unregister(&m[i]))
+                return NULL;
+            m[i].map = NULL;
+        }
+        if ((m[i].map = mcdb_mmap_thread_register_shared(reg->mapptr)) == NULL)
+            return NULL;
+        mcdb_iter_init(&iter, &m[i]);
+        if (!mcdb_iter(&iter)
+            || !mcdb_find(&m[i], (const char *)mcdb_iter_keyptr(&iter),
+                          mcdb_iter_keylen(&iter)))
+            return NULL;
+        if (!mcdb_mmap_reopen_threadsafe(reg->mapptr))
+            return NULL;
+        if (!mcdb_thread_refresh_self(&m[i]))
+            return NULL;
+        i = (i + 1) % TESTMCDBMMAP_HOLD;
+    }
+    for (i = 0; i < TESTMCDBMMAP_HOLD; ++i) {
+        if (m[i].map != NULL && !mcdb_thread_unregister(&m[i]))
+            return NULL;
+    }
+    reg->rc = 0;
+    return NULL;
+}
+
+/* register and unregister use of shared mcdb_mmap on n threads (started
+ * anew each round) while threads reopen it; replaced mcdb_mmap must all be
+ * reclaimed once all registrations are released */
+static int
+testmcdbmmap_reopen (const char * const fname, unsigned long n,
+                     const unsigned long rounds)
+{
+    struct testmcdbmmap_reg reg[64];
+    struct mcdb_mmap *map;
+    unsigned long i, r;
+    int rc = 0;
+
+    map = mcdb_mmap_create(NULL, ".", fname, malloc, free);
+    if (map == NULL) {perror("mcdb_mmap_create"); return -1;}
+    if (n > sizeof(reg)/sizeof(*reg)) n = sizeof(reg)/sizeof(*reg);
+    for (r = 0; r < rounds && rc == 0; ++r) {
+        for (i = 0; i < n; ++i) {
+            reg[i].mapptr = &map;
+            reg[i].n = 50;
+            if (0 != pthread_create(&reg[i].thread, NULL,
+                                    testmcdbmmap_reg_thread, reg+i))
+                {perror("pthread_create"); n = i; rc = -1; break;}
+        }
+        for (i = 0; i < n; ++i) {
+            pthread_join(reg[i].thread, NULL);
+            if (reg[i].rc != 0)
+                {fprintf(stderr,"thread %lu: registration failed\n",i);rc=-1;}
+        }
+    }
+
+    /* all registrations released; replaced mcdb_mmap reclaimed upon reopen */
+    if (rc == 0 && (!mcdb_mmap_reopen_threadsafe(&map)
+                    || map->prev != NULL || map->refcnt != 1))
+        {fprintf(stderr, "replaced mcdb_mmap not reclaimed\n"); rc = -1;}
+    mcdb_mmap_destroy(map);
+    return rc;
+}
+
+#endif
+
+/* get mcdb_mmap from cache and release registration (mcdb_mmap stays cached;
+ * returned ptr is used only to identify struct mcdb_mmap reused by cache) */
+static const struct mcdb_mmap *
+testmcdbmmap_cache_get (struct mcdb_mmap_cache * const restrict cache,
+                        const char * const restrict fname)
+{
+    struct mcdb m;
+    const struct mcdb_mmap *map;
+    memset(&m, '\0', sizeof(m));
+    if ((map = m.map = mcdb_mmap_cache_get(cache, fname)) != NULL)
+        (void)mcdb_thread_unregister(&m);
+    return map;
+}
+
+#define testmcdbmmap_cache_fail(msg) \
+  do { fprintf(stderr, "cache: %s\n", (msg)); rc = -1; } while (0)
+
+/* mcdb_mmap_cache hits, LRU eviction at maxmaps and at maxbytes, EBUSY when
+ * all cached mcdb_mmap are in use, EFBIG, and refresh of replaced mcdb
+ * (mcdb a, b, c are same size; big is more than twice that size;
+ *  big is renamed over a to test refresh) */
+static int
+testmcdbmmap_cache (const char * const a, const char * const b,
+                    const char * const c, const char * const big)
+{
+    struct mcdb_mmap_cache *cache;
+    const struct mcdb_mmap *ma, *mb;
+    struct mcdb m1, m2;
+    struct stat st;
+    uintptr_t sz, bigsz;
+    int rc = 0;
+
+    if (stat(a, &st) != 0)   {perror("stat"); return -1;}
+    sz = (uintptr_t)st.st_size;
+    if (stat(big, &st) != 0) {perror("stat"); return -1;}
+    bigsz = (uintptr_t)st.st_size;
+
+    /* hits; least-recently-used evicted at maxmaps; EBUSY if all in use
+     * (struct mcdb_mmap of evicted entry is reused for next mcdb opened) */
+    cache = mcdb_mmap_cache_create(".", 2, ~(uintptr_t)0, 0, malloc, free);
+    if (cache == NULL) {perror("mcdb_mmap_cache_create"); return -1;}
+    ma = testmcdbmmap_cache_get(cache, a);
+    mb = testmcdbmmap_cache_get(cache, b);
+    if (ma == NULL || mb == NULL || ma == mb)
+        testmcdbmmap_cache_fail("get");
+    else if (testmcdbmmap_cache_get(cache, a) != ma)
+        testmcdbmmap_cache_fail("hit");
+    else if (testmcdbmmap_cache_get(cache, c) != mb)
+        testmcdbmmap_cache_fail("evict least-recently-used at maxmaps");
+    else if (testmcdbmmap_cache_get(cache, a) != ma)
+        testmcdbmmap_cache_fail("evicted most-recently-used");
+    else {
+        memset(&m1, '\0', sizeof(m1));
+        memset(&m2, '\0', sizeof(m2));
+        m1.map = mcdb_mmap_cache_get(cache, a);
+        m2.map = mcdb_mmap_cache_get(cache, c);
+        errno = 0;
+        if (m1.map == NULL || m2.map == NULL)
+            testmcdbmmap_cache_fail("get in use");
+        else if (testmcdbmmap_cache_get(cache, b) != NULL || errno != EBUSY)
+            testmcdbmmap_cache_fail("evicted mcdb in use (expecting EBUSY)");
+        if (m1.map != NULL) (void)mcdb_thread_unregister(&m1);
+        if (m2.map != NULL) (void)mcdb_thread_unregister(&m2);
+        if (rc == 0 && testmcdbmmap_cache_get(cache, b) == NULL)
+            testmcdbmmap_cache_fail("evict after release");
+    }
+    mcdb_mmap_cache_destroy(cache);
+
+    /* least-recently-used evicted at maxbytes; EFBIG if mcdb > maxbytes */
+    cache = mcdb_mmap_cache_create(".", 8, sz*2, 0, malloc, free);
+    if (cache == NULL) {perror("mcdb_mmap_cache_create"); return -1;}
+    ma = testmcdbmmap_cache_get(cache, a);
+    mb = testmcdbmmap_cache_get(cache, b);
+    if (ma == NULL || mb == NULL)
+        testmcdbmmap_cache_fail("get");
+    else if (testmcdbmmap_cache_get(cache, c) == NULL
+             || ma->ptr != NULL || mb->ptr == NULL) /*(evicted are unmapped)*/
+        testmcdbmmap_cache_fail("evict least-recently-used at maxbytes");
+    else if (testmcdbmmap_cache_get(cache, big) != NULL || errno != EFBIG)
+        testmcdbmmap_cache_fail("mcdb larger than maxbytes (expecting EFBIG)");
+    mcdb_mmap_cache_destroy(cache);
+
+    /* refresh (MCDB_MMAP_CACHE_REFRESH) reopens mcdb replaced by rename() */
+    cache = mcdb_mmap_cache_create(".", 2, ~(uintptr_t)0,
+                                   MCDB_MMAP_CACHE_REFRESH, malloc, free);
+    if (cache == NULL) {perror("mcdb_mmap_cache_create"); return -1;}
+    if ((ma = testmcdbmmap_cache_get(cache, a)) == NULL || ma->size != sz)
+        testmcdbmmap_cache_fail("get");
+    else if (rename(big, a) != 0)
+        {perror("rename"); rc = -1;}
+    else if ((ma = testmcdbmmap_cache_get(cache, a)) == NULL
+             || ma->size != bigsz)
+        testmcdbmmap_cache_fail("refresh");
+    mcdb_mmap_cache_destroy(cache);
+
+    return rc;
+}
+
+/* mcdb_mmap_hot_save() records resident pages to mcdb + ".hot", and
+ * mcdb_mmap_hot_replay() replays recording (mcdb_mmap destroyed right after
+ * replay), then again upon reopen of mcdb */
+static int
+testmcdbmmap_hot (const char * const fname)
+{
+    struct mcdb m;
+    struct mcdb_iter iter;
+    struct mcdb_mmap *map;
+    struct stat st;
+    char fn[256];
+    const long pgsz = sysconf(_SC_PAGESIZE);
+    const uintptr_t psz = pgsz > 0 ? (uintptr_t)pgsz : 4096;
+    int rc = 0, i;
+
+    if (strlen(fname) + sizeof(".hot") > sizeof(fn)) return -1;
+    memcpy(fn, fname, strlen(fname));
+    memcpy(fn+strlen(fname), ".hot", sizeof(".hot"));
+    for (i = 0; i < 2 && rc == 0; ++i) {
+        map = mcdb_mmap_create(NULL, ".", fname, malloc, free);
+        if (map == NULL) {perror("mcdb_mmap_create"); return -1;}
+        memset(&m, '\0', sizeof(m));
+        m.map = map;
+        if (i == 0) {
+            mcdb_iter_init(&iter, &m);   /* fault in data pages */
+            while (mcdb_iter(&iter))
+                ;
+            if (!mcdb_mmap_hot_save(map)) {
+                mcdb_mmap_destroy(map);
+                if (errno == ENOSYS)
+                    return 0; /* (mincore() not available; nothing to test) */
+                perror("mcdb_mmap_hot_save");
+                return -1;
+            }
+            if (stat(fn, &st) != 0
+                || (uintptr_t)st.st_size
+                     != 16 + ((map->size + psz - 1) / psz + 7) / 8)
+                {fprintf(stderr, "hot: recording size\n"); rc = -1;}
+        }
+        if (!mcdb_mmap_hot_replay(map))
+            {perror("mcdb_mmap_hot_replay"); rc = -1;}
+        mcdb_mmap_destroy(map);
+    }
+    return rc;
+}
+
+/* lookup in same struct mcdb across reopen of mcdb replaced by mcdb of same
+ * records built with different hash id and seed (a and b; hard link of each
+ * alternately renamed over mcdb before each lookup) */
+static int
+testmcdbmmap_rehash (const char * const fname, const char * const a,
+                     const char * const b)
+{
+    struct mcdb m;
+    struct mcdb_iter iter;
+    struct mcdb_mmap *map;
+    char *keys, *k, *end;
+    char fn[256];
+    uint32_t klen;
+    unsigned long n;
+    int rc = 0;
+
+    if (strlen(fname) + sizeof(".tmp") > sizeof(fn)) return -1;
+    memcpy(fn, fname, strlen(fname));
+    memcpy(fn+strlen(fname), ".tmp", sizeof(".tmp"));
+    map = mcdb_mmap_create(NULL, ".", fname, malloc, free);
+    if (map == NULL) {perror("mcdb_mmap_create"); return -1;}
+    memset(&m, '\0', sizeof(m));
+    if ((m.map = mcdb_mmap_thread_register_shared(&map)) == NULL
+        || (keys = malloc(map->size)) == NULL) {
+        perror("testmcdbmmap_rehash");
+        if (m.map != NULL) (void)mcdb_thread_unregister(&m);
+        mcdb_mmap_destroy(map);
+        return -1;
+    }
+
+    /* copy keys (mcdb_mmap of fname is released upon refresh)
+     * (each record is 8-byte header + key + data; copies fit in map->size) */
+    end = keys;
+    mcdb_iter_init(&iter, &m);
+    while (mcdb_iter(&iter)) {
+        klen = mcdb_iter_keylen(&iter);
+        memcpy(end, &klen, sizeof(klen));
+        memcpy(end+sizeof(klen), mcdb_iter_keyptr(&iter), klen);
+        end += sizeof(klen) + klen;
+    }
+
+    for (k = keys, n = 0; k < end && rc == 0; k += sizeof(klen)+klen, ++n) {
+        memcpy(&klen, k, sizeof(klen));
+        if (link((n & 1) ? b : a, fn) != 0 || rename(fn, fname) != 0)
+            {perror("rename"); rc = -1;}
+        else if (!mcdb_mmap_reopen_threadsafe(&map))
+            {perror("mcdb_mmap_reopen_threadsafe"); rc = -1;}
+        else if (!mcdb_find(&m, k+sizeof(klen), klen) || m.map != map)
+            {fprintf(stderr, "rehash: key %lu not found\n", n); rc = -1;}
+    }
+
+    (void)mcdb_thread_unregister(&m);
+    free(keys);
+    mcdb_mmap_destroy(map);
+    return rc;
+}
+
+int
+main (int argc, char **argv)
+{
+    /* testmcdbmmap -r mcdb nthreads   (register/unregister vs reopen)
+     * testmcdbmmap -c a b c big       (mcdb_mmap_cache; see above)
+     * testmcdbmmap -h mcdb            (hot page record/replay)
+     * testmcdbmmap -x mcdb a b        (lookup across reopen; see above) */
+    if (argc < 3 || argv[1][0] != '-') return -1;
+    switch (argv[1][1]) {
+      case 'h':
+        return testmcdbmmap_hot(argv[2]);
+      case 'r':
+        if (argc < 4) return -1;
+      #ifdef _THREAD_SAFE
+        return testmcdbmmap_reopen(argv[2], strtoul(argv[3], NULL, 10), 20);
+      #else
+        return 0; /* (nothing to test if not compiled _THREAD_SAFE) */
+      #endif
+      case 'c':
+        return argc == 6 ? testmcdbmmap_cache(argv[2],argv[3],argv[4],argv[5])
+                         : -1;
+      case 'x':
+        return argc == 5 ? testmcdbmmap_rehash(argv[2],argv[3],argv[4]) : -1;
+      default:
+        return -1;
+    }
+}
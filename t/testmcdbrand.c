@@ -55,6 +55,212 @@
 #include <string.h>
 #include <unistd.h>
 
+#ifdef _THREAD_SAFE
+#include <pthread.h>
+
+/* fault pool completion: signal waiting lookup */
+struct testmcdbrand_fault {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned long done;
+};
+
+static void
+testmcdbrand_fault_done (void * const arg)
+{
+    struct testmcdbrand_fault * const f = arg;
+    pthread_mutex_lock(&f->mutex);
+    ++f->done;
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->mutex);
+}
+
+static struct testmcdbrand_fault testmcdbrand_faults =
+  { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+#endif
+
+/* fault in page at pos (mcdb_fault_pool, if available) for repeat of lookup
+ * which returned MCDB_TRY_WOULDBLOCK */
+static bool
+testmcdbrand_fault (struct mcdb_fault_pool * const pool,
+                    struct mcdb_mmap * const map, const uintptr_t pos)
+{
+  #ifdef _THREAD_SAFE
+    struct testmcdbrand_fault * const f = &testmcdbrand_faults;
+    unsigned long done;
+    if (pool != NULL) {
+        pthread_mutex_lock(&f->mutex);
+        done = f->done;
+        if (!mcdb_fault_pool_submit(pool, map, pos,
+                                    testmcdbrand_fault_done, f)) {
+            pthread_mutex_unlock(&f->mutex);
+            return false;
+        }
+        while (f->done == done)
+            pthread_cond_wait(&f->cond, &f->mutex);
+        pthread_mutex_unlock(&f->mutex);
+        return true;
+    }
+  #else
+    (void)pool;
+  #endif
+    if (pos >= map->size)
+        return false;
+    (void)*(volatile const unsigned char *)(map->ptr + pos);
+    return true;
+}
+
+/* check mcdb_findtrystart() and mcdb_findtrynext() against mcdb_findstart()
+ * and mcdb_findnext() for each key in mcdb (and a key not in mcdb), faulting
+ * in pages with mcdb_fault_pool, which must release map refcnt it takes */
+static int
+testmcdbrand_try_check (struct mcdb * const restrict m)
+{
+    struct mcdb_iter iter;
+    struct mcdb m1, m2;
+    struct mcdb_fault_pool *pool;
+    const char *key;
+    size_t klen;
+    uintptr_t pos;
+    unsigned long nfaults = 0;
+    const uint32_t refcnt = m->map->refcnt;
+    int rc = 0, t;
+    bool more = true, f;
+    static const char missing[] = "testmcdbrand: key not in mcdb";
+
+    errno = 0;
+    if (mcdb_fault_pool_create(0) != NULL
+        || (errno != EINVAL && errno != ENOSYS)) {
+        fprintf(stderr, "mcdb_fault_pool_create(0) (expecting EINVAL)\n");
+        return -1;
+    }
+    pool = mcdb_fault_pool_create(2);  /*(NULL if not _THREAD_SAFE)*/
+    mcdb_iter_init(&iter, m);
+    while (more && rc == 0) {
+        if ((more = mcdb_iter(&iter))) {
+            key  = (const char *)mcdb_iter_keyptr(&iter);
+            klen = mcdb_iter_keylen(&iter);
+        }
+        else {
+            key  = missing;
+            klen = sizeof(missing)-1;
+        }
+        m1 = *m;
+        m2 = *m;
+        /*(try lookup before mcdb_find() faults in pages)*/
+        while ((t = mcdb_findtrystart(&m2, key, klen, &pos))
+               == MCDB_TRY_WOULDBLOCK && testmcdbrand_fault(pool, m2.map, pos))
+            ++nfaults;
+        f = mcdb_findstart(&m1, key, klen);
+        if (t != (int)f) {
+            fprintf(stderr, "findtrystart: %d != %d\n", t, f);
+            rc = -1;
+        }
+        while (f && rc == 0) {
+            while ((t = mcdb_findtrynext(&m2, key, klen, &pos))
+                   == MCDB_TRY_WOULDBLOCK
+                   && testmcdbrand_fault(pool, m2.map, pos))
+                ++nfaults;
+            f = mcdb_findnext(&m1, key, klen);
+            if (t != (int)f) {
+                fprintf(stderr, "findtrynext: %d != %d\n", t, f);
+                rc = -1;
+            }
+            else if (f && (mcdb_datapos(&m1) != mcdb_datapos(&m2)
+                           || mcdb_datalen(&m1) != mcdb_datalen(&m2))) {
+                fprintf(stderr, "findtrynext: datapos %lu != %lu\n",
+                        (unsigned long)mcdb_datapos(&m2),
+                        (unsigned long)mcdb_datapos(&m1));
+                rc = -1;
+            }
+        }
+    }
+    mcdb_fault_pool_destroy(pool);
+    if (m->map->refcnt != refcnt) {
+        fprintf(stderr, "fault pool: refcnt %u != %u after %lu faults\n",
+                (unsigned int)m->map->refcnt, (unsigned int)refcnt, nfaults);
+        rc = -1;
+    }
+    return rc;
+}
+
+/* check mcdb_findmany() against mcdb_find() for each key in mcdb
+ * (and a key not in mcdb): found, datapos, datalen, and duplicates
+ * returned by mcdb_findnext() must match; each record must be found */
+static int
+testmcdbrand_findmany_check (struct mcdb * const restrict m)
+{
+    struct mcdb_iter iter;
+    struct mcdb mb[64];
+    struct mcdb m1;
+    const char *keys[64];
+    size_t klens[64];
+    uintptr_t ipos[64];
+    size_t i, n, nfound, nrecs = 0;
+    bool more = true, seen, f, fm;
+    static const char missing[] = "testmcdbrand: key not in mcdb";
+
+    mcdb_iter_init(&iter, m);
+    while (more) {
+        for (n = 0; n < 63 && (more = mcdb_iter(&iter)); ++n) {
+            keys[n]  = (const char *)mcdb_iter_keyptr(&iter);
+            klens[n] = mcdb_iter_keylen(&iter);
+            ipos[n]  = (uintptr_t)mcdb_iter_datapos(&iter);
+        }
+        keys[n]  = missing;
+        klens[n] = sizeof(missing)-1;
+        ipos[n]  = 0;
+        ++n;
+        for (i = 0; i < n; ++i)
+            mb[i] = *m;
+        nfound = mcdb_findmany(mb, n, keys, klens);
+        for (i = 0; i < n; ++i) {
+            m1 = *m;
+            f  = mcdb_find(&m1, keys[i], klens[i]);
+            fm = mcdb_findmany_found(&mb[i]);
+            if (f != fm) {
+                fprintf(stderr, "findmany: found %d != %d\n", fm, f);
+                return -1;
+            }
+            nfound -= f;
+            seen = (ipos[i] == 0);
+            while (f) {
+                if (mcdb_datapos(&m1) != mcdb_datapos(&mb[i])
+                    || mcdb_datalen(&m1) != mcdb_datalen(&mb[i])) {
+                    fprintf(stderr, "findmany: datapos %lu != %lu\n",
+                            (unsigned long)mcdb_datapos(&mb[i]),
+                            (unsigned long)mcdb_datapos(&m1));
+                    return -1;
+                }
+                if (mcdb_datapos(&m1) == ipos[i])
+                    seen = true;
+                f  = mcdb_findnext(&m1, keys[i], klens[i]);
+                fm = mcdb_findnext(&mb[i], keys[i], klens[i]);
+                if (f != fm) {
+                    fprintf(stderr, "findmany: findnext %d != %d\n", fm, f);
+                    return -1;
+                }
+            }
+            if (!seen) {
+                fprintf(stderr, "find: record at %lu not found\n",
+                        (unsigned long)ipos[i]);
+                return -1;
+            }
+        }
+        if (nfound != 0) {
+            fprintf(stderr, "findmany: count of keys found mismatch\n");
+            return -1;
+        }
+        nrecs += n-1;
+    }
+    if (nrecs != mcdb_numrecs(m)) {
+        fprintf(stderr, "iter: %lu records != %lu\n",
+                (unsigned long)nrecs, (unsigned long)mcdb_numrecs(m));
+        return -1;
+    }
+    return 0;
+}
+
 int main (int argc, char *argv[])
 {
     const char *p;
@@ -63,19 +269,36 @@ int main (int argc, char *argv[])
     struct mcdb_mmap map;
     struct stat st;
     int fd;
+    int mode = 0;
     const unsigned int klen = 8;
     /* input stream must have keys of constant len 8 */
 
+    /* testmcdbrand mcdb keys [batch]
+     * testmcdbrand -c mcdb   (check mcdb_findmany() against mcdb_find())
+     * testmcdbrand -t mcdb   (check mcdb_findtry*() against mcdb_find()) */
     if (argc < 3) return -1;
 
     /* open mcdb */
+    if (argv[1][0] == '-' && argv[1][1] != '\0' && argv[1][2] == '\0')
+        mode = (++argv)[0][1];
     if ((fd = open(argv[1], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
     memset(&map, '\0', sizeof(map));
     if (!mcdb_mmap_init(&map, fd))                  {perror("mcdb"); return -1;}
+  #ifdef POSIX_FADV_DONTNEED
+    /* drop pages of mcdb from page cache so that try lookups would block
+     * (flush dirty pages of newly made mcdb so that they can be dropped) */
+    if (mode == 't' && fdatasync(fd) == 0)
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  #endif
     close(fd);
     memset(&m, '\0', sizeof(m));
     m.map = &map;
+
+    if (mode == 't')
+        return testmcdbrand_try_check(&m);
     mcdb_mmap_prefault(m.map);
+    if (mode == 'c')
+        return testmcdbrand_findmany_check(&m);
 
     /* open input file */
     if ((fd = open(argv[2], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
@@ -89,7 +312,25 @@ int main (int argc, char *argv[])
 
     /* read each key from input mmap and query mcdb
      * (no error checking since key might not exist) */
-    for (end = p+st.st_size; p < end; p += klen)
-        fd = mcdb_find(&m, p, klen); /*(reuse fd; avoid unused result warning)*/
+    end = p+st.st_size;
+    if (argc < 4) {
+        for (; p < end; p += klen)
+            fd = mcdb_find(&m, p, klen);/*(reuse fd; avoid unused result warning)*/
+    }
+    else { /* batch lookups with mcdb_findmany() */
+        struct mcdb mb[64];
+        const char *keys[64];
+        size_t klens[64];
+        size_t n;
+        for (n = 0; n < 64; ++n) {
+            mb[n] = m;
+            klens[n] = klen;
+        }
+        while (p < end) {
+            for (n = 0; n < 64 && p < end; ++n, p += klen)
+                keys[n] = p;
+            (void) mcdb_findmany(mb, n, keys, klens);
+        }
+    }
     return 0;
 }
@@ -160,6 +160,45 @@ uint32_hash_identity(uint32_t h       __attribute__((unused)),
 }
 #endif
 
+/* 32-bit integer finalizer (avalanche) from MurmurHash3 (Public Domain) */
+uint32_t  C99INLINE  __attribute_pure__
+uint32_mix32(uint32_t)
+  __attribute_warn_unused_result__  __attribute_nothrow__;
+#if !defined(NO_C99INLINE)
+uint32_t  C99INLINE
+uint32_mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+#endif
+
+/* (not inlined in header) */
+
+/* CRC32C (Castagnoli) hash, initial value h (0 for standard CRC32C)
+ * (hardware CRC32C instruction if SSE4.2 (x86_64) or ARMv8 CRC32 available)
+ * (streamable, like djb hash: hash of key in parts equals hash of entire key)*/
+uint32_t  __attribute_pure__
+uint32_hash_crc32c(uint32_t, const void * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
+/* multiply-mix hash, 16 bytes per round, initial value h (seed)
+ * (not streamable: hash must be computed over entire key in one call)
+ * (uint32_hash_mix_tag() hashes tag char followed by key without copying) */
+uint32_t  __attribute_pure__
+uint32_hash_mix(uint32_t, const void * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+uint32_t  __attribute_pure__
+uint32_hash_mix_tag(uint32_t, unsigned char, const void * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
 
 /* 
  * branchless implementations for comparing two ints and selecting int results